@@ -24,6 +24,22 @@ print_error() {
     echo -e "${RED}[ERROR]${NC} $1"
 }
 
+# Packet scheduler paired with BBR: fq, which paces, or fq_codel where fq is
+# not available. bench_bbr3.sh sources this script for it, so benchmarks run
+# with the qdisc production hosts get.
+select_qdisc() {
+    if tc qdisc help 2>&1 | grep -q "fq"; then
+        echo "fq"
+    else
+        echo "fq_codel"
+    fi
+}
+
+# When sourced, only provide the functions above
+if [ "${BASH_SOURCE[0]}" != "$0" ]; then
+    return 0
+fi
+
 # Check if running as root
 if [ "$EUID" -ne 0 ]; then
     print_error "Please run as root (with sudo)"
@@ -38,11 +54,9 @@ if ! grep -q "bbr" /proc/sys/net/ipv4/tcp_available_congestion_control 2>/dev/nu
 fi
 
 # Check if FQ qdisc is available
-if ! tc qdisc help 2>&1 | grep -q "fq"; then
+DEFAULT_QDISC=$(select_qdisc)
+if [ "$DEFAULT_QDISC" != "fq" ]; then
     print_warning "FQ qdisc may not be available, falling back to fq_codel"
-    DEFAULT_QDISC="fq_codel"
-else
-    DEFAULT_QDISC="fq"
 fi
 
 echo "====== BBR OPTIMIZATION SCRIPT ======"
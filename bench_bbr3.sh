@@ -0,0 +1,302 @@
+#!/bin/bash
+
+# BBR3 Network Namespace Benchmark
+# Runs bbr3 against bbr and cubic through an emulated bottleneck on this
+# kernel and writes the results as JSON for regression tracking.
+#
+# Topology, one network namespace each:
+#
+#   bbr3-snd --veth--> bbr3-rtr --veth--> bbr3-rcv
+#   (fq, paced)        (htb rate, netem delay/loss, tail-drop buffer)
+#
+# The sender uses the same qdisc bbr_optimized.sh sets up in production. The
+# router adds the whole RTT on its way to the receiver, and the buffer limit
+# is sized in BDPs of the bottleneck.
+#
+# Usage: bench_bbr3.sh [-o results.json] [-t seconds] [-s scenario]...
+
+set -e
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m' # No Color
+
+# Function to print colored output
+print_status() {
+    echo -e "${GREEN}[INFO]${NC} $1" >&2
+}
+
+print_warning() {
+    echo -e "${YELLOW}[WARNING]${NC} $1" >&2
+}
+
+print_error() {
+    echo -e "${RED}[ERROR]${NC} $1" >&2
+}
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+# shellcheck source=bbr_optimized.sh
+source "$SCRIPT_DIR/bbr_optimized.sh"
+
+NS_SND=bbr3-snd
+NS_RTR=bbr3-rtr
+NS_RCV=bbr3-rcv
+RCV_ADDR=10.33.2.2
+BASE_PORT=5301
+
+OUTPUT=bench-results.json
+DURATION=30
+SELECTED=()
+
+# name: rate_mbit rtt_ms buffer_bdp loss_pct flows (cc per flow, run together)
+# Each scenario with a single flow runs once per algorithm in SOLO_CCS.
+SOLO_CCS="bbr3 bbr cubic"
+SCENARIOS=(
+    "single:100 40 1 0 solo"
+    "shallow:100 40 0.1 0 solo"
+    "deep:100 40 8 0 solo"
+    "lossy:100 40 1 1 solo"
+    "fast:1000 10 1 0 solo"
+    "bbr3_vs_bbr:100 40 1 0 bbr3,bbr"
+    "bbr3_vs_cubic:100 40 2 0 bbr3,cubic"
+    "bbr3_x4:100 40 1 0 bbr3,bbr3,bbr3,bbr3"
+)
+
+while getopts "o:t:s:h" opt; do
+    case $opt in
+        o) OUTPUT=$OPTARG ;;
+        t) DURATION=$OPTARG ;;
+        s) SELECTED+=("$OPTARG") ;;
+        *)
+            echo "usage: $0 [-o results.json] [-t seconds] [-s scenario]..." >&2
+            echo "scenarios: ${SCENARIOS[*]%%:*}" >&2
+            exit 2
+            ;;
+    esac
+done
+
+# Check if running as root
+if [ "$EUID" -ne 0 ]; then
+    print_error "Please run as root (with sudo)"
+    exit 1
+fi
+
+for cmd in ip tc ss iperf3 jq; do
+    if ! command -v "$cmd" >/dev/null 2>&1; then
+        print_error "$cmd is required"
+        exit 1
+    fi
+done
+
+# Make sure every algorithm we compare is available
+for cc in bbr3 bbr cubic; do
+    if ! grep -qw "$cc" /proc/sys/net/ipv4/tcp_available_congestion_control; then
+        if [ "$cc" = "bbr3" ] && [ -f "$SCRIPT_DIR/tcp_bbr3.ko" ]; then
+            insmod "$SCRIPT_DIR/tcp_bbr3.ko" || true
+        else
+            modprobe "tcp_$cc" 2>/dev/null || true
+        fi
+    fi
+    if ! grep -qw "$cc" /proc/sys/net/ipv4/tcp_available_congestion_control; then
+        print_error "Congestion control $cc is not available"
+        exit 1
+    fi
+done
+
+# The BPF variant joins the solo runs once bpf/bbr3_loader has registered it
+if grep -qw bbr3_bpf /proc/sys/net/ipv4/tcp_available_congestion_control; then
+    SOLO_CCS="$SOLO_CCS bbr3_bpf"
+fi
+
+QDISC=$(select_qdisc)
+
+cleanup() {
+    ip netns del "$NS_SND" 2>/dev/null || true
+    ip netns del "$NS_RTR" 2>/dev/null || true
+    ip netns del "$NS_RCV" 2>/dev/null || true
+}
+trap cleanup EXIT
+
+# Build the three namespaces and the static parts of the path
+setup_topology() {
+    cleanup
+    ip netns add "$NS_SND"
+    ip netns add "$NS_RTR"
+    ip netns add "$NS_RCV"
+
+    ip link add snd0 netns "$NS_SND" type veth peer name rtr0 netns "$NS_RTR"
+    ip link add rtr1 netns "$NS_RTR" type veth peer name rcv0 netns "$NS_RCV"
+
+    ip -n "$NS_SND" addr add 10.33.1.1/24 dev snd0
+    ip -n "$NS_RTR" addr add 10.33.1.2/24 dev rtr0
+    ip -n "$NS_RTR" addr add 10.33.2.1/24 dev rtr1
+    ip -n "$NS_RCV" addr add "$RCV_ADDR"/24 dev rcv0
+    for ns in "$NS_SND" "$NS_RTR" "$NS_RCV"; do
+        ip -n "$ns" link set lo up
+    done
+    ip -n "$NS_SND" link set snd0 up
+    ip -n "$NS_RTR" link set rtr0 up
+    ip -n "$NS_RTR" link set rtr1 up
+    ip -n "$NS_RCV" link set rcv0 up
+    ip -n "$NS_SND" route add default via 10.33.1.2
+    ip -n "$NS_RCV" route add default via 10.33.2.1
+    ip netns exec "$NS_RTR" sysctl -qw net.ipv4.ip_forward=1
+
+    # Production pacing qdisc on the sender. Offloads are off so the
+    # bottleneck sees wire-sized packets, as it would on a real path.
+    tc -n "$NS_SND" qdisc replace dev snd0 root "$QDISC"
+    ip netns exec "$NS_SND" ethtool -K snd0 tso off gso off 2>/dev/null || true
+    ip netns exec "$NS_RTR" ethtool -K rtr1 tso off gso off gro off 2>/dev/null || true
+}
+
+# Shape rtr1 into the bottleneck: htb for the rate, netem for delay and loss,
+# with the netem limit as the buffer
+set_bottleneck() {
+    local rate_mbit=$1 rtt_ms=$2 buffer_bdp=$3 loss_pct=$4
+    local bdp_pkts limit
+
+    bdp_pkts=$(( rate_mbit * 1000 * rtt_ms / 8 / 1500 ))
+    # netem holds the packets in flight on the wire (one BDP) on top of
+    # the buffer itself
+    limit=$(awk -v b="$bdp_pkts" -v f="$buffer_bdp" \
+        'BEGIN { l = int(b * (f + 1)); print (l < 8 ? 8 : l) }')
+
+    tc -n "$NS_RTR" qdisc del dev rtr1 root 2>/dev/null || true
+    tc -n "$NS_RTR" qdisc add dev rtr1 root handle 1: htb default 1
+    tc -n "$NS_RTR" class add dev rtr1 parent 1: classid 1:1 htb \
+        rate "${rate_mbit}mbit" ceil "${rate_mbit}mbit"
+    tc -n "$NS_RTR" qdisc add dev rtr1 parent 1:1 handle 10: netem \
+        delay "${rtt_ms}ms" loss "${loss_pct}%" limit "$limit"
+}
+
+# Append "srtt_ms minrtt_ms" lines for the flow to $port to $out, sampling
+# ss every 200ms until killed. iperf3's control connection goes to the same
+# port and sits idle at the base RTT, so only the socket with the most bytes
+# ACKed, the data connection, counts.
+sample_rtt() {
+    local port=$1 out=$2
+
+    : > "$out"
+    while true; do
+        ip netns exec "$NS_SND" ss -tin dst "$RCV_ADDR" and dport = ":$port" 2>/dev/null |
+            awk '/ rtt:/ {
+                srtt = ""; minrtt = ""; acked = 0
+                for (i = 1; i <= NF; i++) {
+                    if ($i ~ /^rtt:/) { split(substr($i, 5), a, "/"); srtt = a[1] }
+                    if ($i ~ /^minrtt:/) minrtt = substr($i, 8)
+                    if ($i ~ /^bytes_acked:/) acked = substr($i, 13) + 0
+                }
+                if (srtt != "" && (best == "" || acked > best_acked)) {
+                    best = srtt " " minrtt; best_acked = acked
+                }
+            }
+            END { if (best != "") print best }' >> "$out"
+        sleep 0.2
+    done
+}
+
+# Run one set of concurrent flows; print a JSON array with one object each
+run_flows() {
+    local ccs=$1 rtt_ms=$2
+    local i=0 cc port pids=() samplers=() tmp
+
+    tmp=$(mktemp -d)
+    IFS=, read -r -a flows <<< "$ccs"
+    for cc in "${flows[@]}"; do
+        port=$(( BASE_PORT + i ))
+        ip netns exec "$NS_RCV" iperf3 -s -1 -p "$port" >/dev/null 2>&1 &
+        i=$(( i + 1 ))
+    done
+    sleep 1
+
+    i=0
+    for cc in "${flows[@]}"; do
+        port=$(( BASE_PORT + i ))
+        ip netns exec "$NS_SND" iperf3 -c "$RCV_ADDR" -p "$port" -C "$cc" \
+            -t "$DURATION" -J > "$tmp/iperf.$i.json" 2>/dev/null &
+        pids+=($!)
+        sample_rtt "$port" "$tmp/rtt.$i" &
+        samplers+=($!)
+        i=$(( i + 1 ))
+    done
+    for pid in "${pids[@]}"; do
+        wait "$pid" || true
+    done
+    kill "${samplers[@]}" 2>/dev/null || true
+    wait 2>/dev/null || true
+
+    i=0
+    for cc in "${flows[@]}"; do
+        local rtt_stats
+        rtt_stats=$(awk -v base="$rtt_ms" '
+            { s += $1; n++; if ($2 != "" && (m == "" || $2 < m)) m = $2 }
+            END {
+                if (!n) { print "null null null"; exit }
+                printf "%.3f %s %.3f\n", s / n, (m == "" ? "null" : m), (s / n) / base
+            }' "$tmp/rtt.$i")
+        read -r srtt_avg minrtt inflation <<< "$rtt_stats"
+        jq -c --arg cc "$cc" --argjson srtt "$srtt_avg" \
+            --argjson minrtt "$minrtt" --argjson inflation "$inflation" '
+            (.end.sum_received.bits_per_second // 0) as $bps |
+            (.end.cpu_utilization_percent.host_total // 0) as $cpu |
+            {
+                cc: $cc,
+                mbps: ($bps / 1e6),
+                retransmits: (.end.sum_sent.retransmits // null),
+                srtt_ms_avg: $srtt,
+                minrtt_ms: $minrtt,
+                rtt_inflation: $inflation,
+                sender_cpu_pct: $cpu,
+                cpu_pct_per_gbit: (if $bps > 0 then $cpu / ($bps / 1e9) else null end)
+            }' "$tmp/iperf.$i.json" 2>/dev/null ||
+            jq -nc --arg cc "$cc" '{ cc: $cc, error: "iperf3 failed" }'
+        i=$(( i + 1 ))
+    done | jq -sc '.'
+    rm -rf "$tmp"
+}
+
+setup_topology
+print_status "Sender qdisc: $QDISC, $DURATION s per run"
+
+RESULTS=()
+for entry in "${SCENARIOS[@]}"; do
+    name=${entry%%:*}
+    read -r rate rtt buffer loss flows <<< "${entry#*:}"
+    if [ ${#SELECTED[@]} -gt 0 ] && [[ ! " ${SELECTED[*]} " =~ " $name " ]]; then
+        continue
+    fi
+
+    set_bottleneck "$rate" "$rtt" "$buffer" "$loss"
+    if [ "$flows" = "solo" ]; then
+        runs=$SOLO_CCS
+    else
+        runs=$flows
+    fi
+    for ccs in $runs; do
+        print_status "$name: ${rate}mbit ${rtt}ms ${buffer}xBDP ${loss}% loss, flows $ccs"
+        result=$(run_flows "$ccs" "$rtt")
+        RESULTS+=("$(jq -nc --arg name "$name" --argjson rate "$rate" \
+            --argjson rtt "$rtt" --argjson buffer "$buffer" \
+            --argjson loss "$loss" --argjson flows "$result" '
+            ($flows | map(.mbps // 0)) as $t |
+            {
+                scenario: $name, rate_mbit: $rate, rtt_ms: $rtt,
+                buffer_bdp: $buffer, loss_pct: $loss, flows: $flows,
+                utilization: (($t | add) / $rate),
+                jain: (if ($t | map(. * .) | add) > 0
+                       then (($t | add) * ($t | add)) /
+                            (($t | length) * ($t | map(. * .) | add))
+                       else null end)
+            }')")
+    done
+done
+
+printf '%s\n' "${RESULTS[@]}" | jq -s \
+    --arg kernel "$(uname -r)" --arg qdisc "$QDISC" \
+    --arg date "$(date -u +%Y-%m-%dT%H:%M:%SZ)" \
+    --argjson duration "$DURATION" \
+    '{ kernel: $kernel, date: $date, qdisc: $qdisc, duration_s: $duration,
+       results: . }' > "$OUTPUT"
+print_status "Results written to $OUTPUT"
@@ -0,0 +1,132 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/* The kernel API used by ../tcp_bbr3.h, for BPF struct_ops programs.
+ *
+ * vmlinux.h has the types and enums of the running kernel but none of its
+ * macros or inline helpers, so they are redefined here on top of BPF
+ * helpers, in the verifier's terms: unsigned 64-bit division only, no
+ * 128-bit products, and bitfields read through CO-RE.
+ */
+#ifndef _BBR3_BPF_COMPAT_H
+#define _BBR3_BPF_COMPAT_H
+
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+#include <bpf/bpf_core_read.h>
+
+extern unsigned int CONFIG_HZ __kconfig;
+
+#define HZ			CONFIG_HZ
+#define USEC_PER_MSEC		1000UL
+#define USEC_PER_SEC		1000000UL
+#define U16_MAX			((u16)~0U)
+#define U32_MAX			((u32)~0U)
+#define TCP_INIT_CWND		10
+#define MAX_TCP_HEADER		320	/* L1_CACHE_ALIGN(128 + MAX_HEADER) */
+#define GSO_LEGACY_MAX_SIZE	65536u
+#define TCP_ECN_DEMAND_CWR	4
+
+#define likely(x)		__builtin_expect(!!(x), 1)
+#define unlikely(x)		__builtin_expect(!!(x), 0)
+#define READ_ONCE(x)		(*(volatile typeof(x) *)&(x))
+#define WRITE_ONCE(x, v)	(*(volatile typeof(x) *)&(x) = (v))
+#define memset			__builtin_memset
+
+#define min(x, y)		((x) < (y) ? (x) : (y))
+#define max(x, y)		((x) > (y) ? (x) : (y))
+#define min3(x, y, z)		min(min(x, y), z)
+#define min_t(t, x, y)		min((t)(x), (t)(y))
+#define max_t(t, x, y)		max((t)(x), (t)(y))
+#define clamp(v, lo, hi)	min(max(v, lo), hi)
+
+#define before(seq1, seq2)	((s32)((u32)(seq1) - (u32)(seq2)) < 0)
+#define after(seq2, seq1)	before(seq1, seq2)
+
+#define tcp_jiffies32		((u32)bpf_jiffies64())
+
+static __always_inline unsigned long msecs_to_jiffies(unsigned int m)
+{
+	return ((u64)m * HZ + 999) / 1000;
+}
+
+#define do_div(n, base) ({			\
+	u32 __base = (base);			\
+	u32 __rem = (n) % __base;		\
+	(n) /= __base;				\
+	__rem;					\
+})
+
+static __always_inline u64 div_u64(u64 dividend, u32 divisor)
+{
+	return dividend / divisor;
+}
+
+/* (a * mul) >> shift in 64-bit halves, for shift <= 32 */
+static __always_inline u64 mul_u64_u32_shr(u64 a, u32 mul, unsigned int shift)
+{
+	u32 ah = a >> 32, al = a;
+	u64 ret;
+
+	ret = ((u64)al * mul) >> shift;
+	if (ah)
+		ret += ((u64)ah * mul) << (32 - shift);
+	return ret;
+}
+
+static __always_inline u32 reciprocal_scale(u32 val, u32 ep_ro)
+{
+	return (u32)(((u64)val * ep_ro) >> 32);
+}
+
+#define get_random_u32()	bpf_get_prandom_u32()
+#define __tcp_send_ack(sk, rcv_nxt)	bpf_tcp_send_ack(sk, rcv_nxt)
+
+static __always_inline struct inet_connection_sock *inet_csk(const struct sock *sk)
+{
+	return (struct inet_connection_sock *)sk;
+}
+
+static __always_inline void *inet_csk_ca(const struct sock *sk)
+{
+	return (void *)inet_csk(sk)->icsk_ca_priv;
+}
+
+static __always_inline struct tcp_sock *tcp_sk(const struct sock *sk)
+{
+	return (struct tcp_sock *)sk;
+}
+
+static __always_inline u32 tcp_packets_in_flight(const struct tcp_sock *tp)
+{
+	return tp->packets_out - (tp->sacked_out + tp->lost_out) +
+	       tp->retrans_out;
+}
+
+static __always_inline u32 tcp_min_rtt(const struct tcp_sock *tp)
+{
+	return tp->rtt_min.s[0].v;
+}
+
+#define bbr3_ca_state(sk)	\
+	((u8)BPF_CORE_READ_BITFIELD(inet_csk(sk), icsk_ca_state))
+#define bbr3_is_cwnd_limited(tp)	\
+	((u8)BPF_CORE_READ_BITFIELD(tp, is_cwnd_limited))
+#define bbr3_is_rwnd_limited(tp)	\
+	((u8)BPF_CORE_READ_BITFIELD(tp, chrono_type) == TCP_CHRONO_RWND_LIMITED)
+
+/* The stack has set the initial cwnd before init runs */
+#define tcp_init_cwnd(tp, dst)	TCP_INIT_CWND
+#define __sk_dst_get(sk)	NULL
+
+/* No tracepoints; the events of tcp_bbr3_trace.h compile away */
+#define BBR3_PROBE_RTT_ENTER	0
+#define BBR3_PROBE_RTT_HOLD	1
+#define BBR3_PROBE_RTT_EXIT	2
+#define trace_bbr3_state_change(...)	do { } while (0)
+#define trace_bbr3_bw_sample(...)	do { } while (0)
+#define trace_bbr3_bw_sample_enabled()	false
+#define trace_bbr3_cwnd_set(...)	do { } while (0)
+#define trace_bbr3_probe_rtt(...)	do { } while (0)
+#define trace_bbr3_ack(...)		do { } while (0)
+
+#endif /* _BBR3_BPF_COMPAT_H */
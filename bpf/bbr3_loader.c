@@ -0,0 +1,269 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/* Register, unregister and inspect the "bbr3_bpf" struct_ops congestion
+ * control.
+ *
+ *   bbr3_loader [-e] [-p name=value]...	load, register and pin
+ *   bbr3_loader -s			print the counters and per-ACK cost
+ *   bbr3_loader -u			unregister
+ *
+ * Registration outlives the loader: the struct_ops link, the counters map
+ * and the cong_control program are pinned under /sys/fs/bpf/tcp_bbr3, and
+ * removing the link pin (-u) unregisters the algorithm once no socket uses
+ * it. The tunables are the
+ * module parameters of tcp_bbr3.ko of the same names, with the same ranges
+ * and defaults. -e registers the module's bbr3_ecn instead, as
+ * "bbr3_bpf_ecn": BBRv3 negotiating ECN and echoing CE per packet.
+ */
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include "tcp_bbr3.skel.h"
+
+#define PIN_DIR		"/sys/fs/bpf/tcp_bbr3"
+#define PIN_LINK	PIN_DIR "/link"
+#define PIN_STATS	PIN_DIR "/stats"
+#define PIN_MAIN	PIN_DIR "/main"
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+
+/* As in include/net/tcp.h */
+#define TCP_CONG_NEEDS_ECN	0x2
+
+/* As in ../tcp_bbr3.h */
+#define BBR3_STAT_MAX			7
+#define BBR3_PACING_HIST_BUCKETS	18
+
+static const char * const stat_names[BBR3_STAT_MAX] = {
+	"init", "startup_exit", "probe_rtt", "inflight_hi_cut", "policer",
+	"warm_start", "ckpt_restore",
+};
+
+#define PARAM(_name, _min, _max) \
+	{ #_name, _min, _max, offsetof(struct tcp_bbr3_bpf__rodata, _name) }
+
+static const struct param {
+	const char *name;
+	int min, max;
+	size_t offset;		/* in the skeleton's rodata */
+} params[] = {
+	PARAM(bbr_mode, 0, 2),
+	PARAM(fast_convergence, 0, 1),
+	PARAM(drain_to_target, 0, 1),
+	PARAM(coexist, 0, 1),
+	PARAM(min_rtt_win_sec, 1, 120),
+	PARAM(probe_rtt_mode_ms, 0, 1000),
+};
+
+static int set_param(struct tcp_bbr3_bpf *skel, const char *arg)
+{
+	const char *eq = strchr(arg, '=');
+	char *end;
+	long val;
+	size_t i;
+
+	if (!eq)
+		return -EINVAL;
+	val = strtol(eq + 1, &end, 0);
+	if (end == eq + 1 || *end)
+		return -EINVAL;
+	for (i = 0; i < ARRAY_SIZE(params); i++) {
+		if (strlen(params[i].name) != (size_t)(eq - arg) ||
+		    strncmp(params[i].name, arg, eq - arg))
+			continue;
+		if (val < params[i].min || val > params[i].max)
+			return -ERANGE;
+		*(int *)((char *)skel->rodata + params[i].offset) = val;
+		return 0;
+	}
+	return -ENOENT;
+}
+
+/* The kernel counts runs and run time of each program while
+ * kernel.bpf_stats_enabled is 1. cong_control runs once per ACK, so the
+ * ratio is the per-ACK cost, trampoline included.
+ */
+static int show_main_cost(void)
+{
+	struct bpf_prog_info info = {};
+	__u32 len = sizeof(info);
+	int fd, err = 0;
+
+	fd = bpf_obj_get(PIN_MAIN);
+	if (fd < 0) {
+		fprintf(stderr, "bbr3_bpf_main is not pinned: %s\n",
+			strerror(errno));
+		return -errno;
+	}
+	if (bpf_obj_get_info_by_fd(fd, &info, &len)) {
+		err = -errno;
+		fprintf(stderr, "reading %s: %s\n", PIN_MAIN, strerror(errno));
+	} else {
+		printf("cong_control_runs %llu\n", info.run_cnt);
+		printf("cong_control_run_ns %llu\n", info.run_time_ns);
+	}
+	close(fd);
+	return err;
+}
+
+static int show_stats(void)
+{
+	int ncpus = libbpf_num_possible_cpus(), fd, cpu, i;
+	unsigned long long sum[BBR3_STAT_MAX + BBR3_PACING_HIST_BUCKETS] = {};
+	unsigned long long *vals;
+	__u32 key = 0;
+
+	if (ncpus < 0)
+		return ncpus;
+	fd = bpf_obj_get(PIN_STATS);
+	if (fd < 0) {
+		fprintf(stderr, "bbr3_bpf is not loaded: %s\n", strerror(errno));
+		return -errno;
+	}
+	vals = calloc(ncpus, sizeof(sum));
+	if (!vals) {
+		close(fd);
+		return -ENOMEM;
+	}
+	if (bpf_map_lookup_elem(fd, &key, vals)) {
+		fprintf(stderr, "reading %s: %s\n", PIN_STATS, strerror(errno));
+		free(vals);
+		close(fd);
+		return -errno;
+	}
+	for (cpu = 0; cpu < ncpus; cpu++)
+		for (i = 0; i < BBR3_STAT_MAX + BBR3_PACING_HIST_BUCKETS; i++)
+			sum[i] += vals[cpu * (BBR3_STAT_MAX +
+					      BBR3_PACING_HIST_BUCKETS) + i];
+
+	for (i = 0; i < BBR3_STAT_MAX; i++)
+		printf("%s %llu\n", stat_names[i], sum[i]);
+	for (i = 0; i < BBR3_PACING_HIST_BUCKETS; i++)
+		printf("pacing_rate_mbps_%lu %llu\n", i ? 1UL << (i - 1) : 0,
+		       sum[BBR3_STAT_MAX + i]);
+	free(vals);
+	close(fd);
+	return show_main_cost();
+}
+
+static int unregister(void)
+{
+	if (unlink(PIN_LINK) && errno != ENOENT)
+		return -errno;
+	if (unlink(PIN_STATS) && errno != ENOENT)
+		return -errno;
+	if (unlink(PIN_MAIN) && errno != ENOENT)
+		return -errno;
+	rmdir(PIN_DIR);
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-p name=value]...  load and register bbr3_bpf\n"
+		"       %s -e [-p name=value]...  ... as bbr3_bpf_ecn\n"
+		"       %s -s                  print counters and per-ACK cost\n"
+		"       %s -u                  unregister\n"
+		"params: bbr_mode (0-2), fast_convergence (0-1), "
+		"drain_to_target (0-1),\n"
+		"        coexist (0-1), min_rtt_win_sec (1-120),\n"
+		"        probe_rtt_mode_ms (0-1000)\n",
+		prog, prog, prog, prog);
+}
+
+int main(int argc, char **argv)
+{
+	struct tcp_bbr3_bpf *skel;
+	struct bpf_link *link;
+	bool ecn = false;
+	int opt, err;
+
+	skel = tcp_bbr3_bpf__open();
+	if (!skel) {
+		fprintf(stderr, "opening the BPF object failed\n");
+		return 1;
+	}
+
+	while ((opt = getopt(argc, argv, "ep:suh")) != -1) {
+		switch (opt) {
+		case 'e':
+			ecn = true;
+			break;
+		case 'p':
+			err = set_param(skel, optarg);
+			if (err) {
+				fprintf(stderr, "bad parameter %s: %s\n",
+					optarg, strerror(-err));
+				goto out;
+			}
+			break;
+		case 's':
+			err = show_stats();
+			goto out;
+		case 'u':
+			err = unregister();
+			if (err)
+				fprintf(stderr, "unregistering failed: %s\n",
+					strerror(-err));
+			goto out;
+		default:
+			usage(argv[0]);
+			err = -EINVAL;
+			goto out;
+		}
+	}
+
+	if (ecn) {
+		/* prior_rcv_nxt shares its slot with v1/v2 state */
+		if (skel->rodata->bbr_mode != 2) {
+			fprintf(stderr, "-e needs bbr_mode=2\n");
+			err = -EINVAL;
+			goto out;
+		}
+		skel->struct_ops.bbr3_bpf->flags |= TCP_CONG_NEEDS_ECN;
+		strcpy(skel->struct_ops.bbr3_bpf->name, "bbr3_bpf_ecn");
+	}
+
+	err = tcp_bbr3_bpf__load(skel);
+	if (err) {
+		fprintf(stderr, "loading failed (see the verifier log above): %s\n",
+			strerror(-err));
+		goto out;
+	}
+	link = bpf_map__attach_struct_ops(skel->maps.bbr3_bpf);
+	if (!link) {
+		err = -errno;
+		fprintf(stderr, "registering %s failed: %s\n",
+			skel->struct_ops.bbr3_bpf->name, strerror(-err));
+		goto out;
+	}
+	if (mkdir(PIN_DIR, 0700) && errno != EEXIST) {
+		err = -errno;
+	} else {
+		err = bpf_link__pin(link, PIN_LINK);
+		if (!err)
+			err = bpf_map__pin(skel->maps.bbr3_stats, PIN_STATS);
+		if (!err)
+			err = bpf_program__pin(skel->progs.bbr3_bpf_main,
+					       PIN_MAIN);
+	}
+	if (err) {
+		fprintf(stderr, "pinning under %s failed: %s\n", PIN_DIR,
+			strerror(-err));
+		bpf_link__unpin(link);
+	} else {
+		printf("%s registered, pinned under %s\n",
+		       skel->struct_ops.bbr3_bpf->name, PIN_DIR);
+	}
+	bpf_link__destroy(link);
+out:
+	tcp_bbr3_bpf__destroy(skel);
+	return err ? 1 : 0;
+}
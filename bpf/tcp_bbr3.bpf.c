@@ -0,0 +1,161 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/* BBRv3 as a BPF struct_ops congestion control, "bbr3_bpf"
+ *
+ * The model is ../tcp_bbr3.h, the same code the kernel module runs, built
+ * against bbr3_bpf_compat.h. What differs is the glue around it:
+ *
+ * - Tunables are read-only globals that bbr3_loader sets before loading,
+ *   host-wide rather than per netns. bbr_mode is among them, and since the
+ *   verifier knows its value it prunes the cong_control branches of the
+ *   other versions, as the module's per-version ops do.
+ * - Counters live in a per-CPU array map, which "bbr3_loader -s" sums.
+ * - There are no tracepoints, get_info (struct_ops does not support it) or
+ *   warm start cache.
+ * - The module's bbr3_ecn is this struct_ops registered by "bbr3_loader -e"
+ *   as "bbr3_bpf_ecn", with the TCP_CONG_NEEDS_ECN flag.
+ */
+#include "bbr3_bpf_compat.h"
+#include "../tcp_bbr3.h"
+
+char _license[] SEC("license") = "GPL";
+
+const volatile int bbr_mode = BBR_V3;
+const volatile int fast_convergence = 1;
+const volatile int drain_to_target = 1;
+const volatile int coexist = 0;
+const volatile int min_rtt_win_sec = 5;
+const volatile int probe_rtt_mode_ms = 200;
+
+_Static_assert(sizeof(struct bbr3) <=
+	       sizeof(((struct inet_connection_sock *)0)->icsk_ca_priv),
+	       "struct bbr3 does not fit in icsk_ca_priv");
+
+/* Summed over all sockets by bbr3_loader -s; same layout as the module's */
+struct bbr3_stats {
+	u64 items[BBR3_STAT_MAX];
+	u64 pacing_hist[BBR3_PACING_HIST_BUCKETS];
+};
+
+struct {
+	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+	__uint(max_entries, 1);
+	__type(key, u32);
+	__type(value, struct bbr3_stats);
+} bbr3_stats SEC(".maps");
+
+static void bbr3_stat_inc(enum bbr3_stat_item item)
+{
+	u32 key = 0;
+	struct bbr3_stats *s = bpf_map_lookup_elem(&bbr3_stats, &key);
+
+	if (s && item < BBR3_STAT_MAX)
+		s->items[item]++;
+}
+
+static void bbr3_stat_pacing_rate(struct sock *sk)
+{
+	u64 mbps = div_u64(sk->sk_pacing_rate, 1000000 / 8);
+	u32 key = 0, i = 0;
+	struct bbr3_stats *s = bpf_map_lookup_elem(&bbr3_stats, &key);
+
+	if (!s)
+		return;
+	while (mbps && i < BBR3_PACING_HIST_BUCKETS - 1) {	/* fls64() */
+		mbps >>= 1;
+		i++;
+	}
+	s->pacing_hist[i]++;
+}
+
+static enum bbr_version bbr3_sk_version(const struct sock *sk)
+{
+	return bbr_mode;
+}
+
+SEC("struct_ops")
+void BPF_PROG(bbr3_bpf_init, struct sock *sk)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	bbr3_init_state(sk);
+	bbr->min_rtt_win_sec = min_rtt_win_sec;
+	bbr->probe_rtt_mode_ms = probe_rtt_mode_ms;
+	bbr->fast_convergence = !!fast_convergence;
+	bbr->drain_to_target = !!drain_to_target;
+	bbr->coexist = bbr_mode != BBR_V1 && coexist;
+
+	bbr3_init_pacing_rate_from_rtt(sk);
+	if (sk->sk_pacing_status == SK_PACING_NONE)
+		sk->sk_pacing_status = SK_PACING_NEEDED;
+}
+
+static __always_inline void bbr3_bpf_main_rs(struct sock *sk,
+					     const struct rate_sample *rs)
+{
+	if (bbr_mode == BBR_V1)
+		__bbr3_main(sk, rs, BBR_V1);
+	else if (bbr_mode == BBR_V2)
+		__bbr3_main(sk, rs, BBR_V2);
+	else
+		__bbr3_main(sk, rs, BBR_V3);
+}
+
+/* Linux 6.10 added the ack and flag arguments; the Makefile checks which
+ * one vmlinux.h has.
+ */
+#ifdef BBR3_CONG_CONTROL_ACK_FLAG
+SEC("struct_ops")
+void BPF_PROG(bbr3_bpf_main, struct sock *sk, u32 ack, int flag,
+	      const struct rate_sample *rs)
+{
+	bbr3_bpf_main_rs(sk, rs);
+}
+#else
+SEC("struct_ops")
+void BPF_PROG(bbr3_bpf_main, struct sock *sk, const struct rate_sample *rs)
+{
+	bbr3_bpf_main_rs(sk, rs);
+}
+#endif
+
+SEC("struct_ops")
+u32 BPF_PROG(bbr3_bpf_ssthresh, struct sock *sk)
+{
+	return bbr3_ssthresh(sk);
+}
+
+SEC("struct_ops")
+u32 BPF_PROG(bbr3_bpf_undo_cwnd, struct sock *sk)
+{
+	return bbr3_undo_cwnd(sk);
+}
+
+SEC("struct_ops")
+u32 BPF_PROG(bbr3_bpf_sndbuf_expand, struct sock *sk)
+{
+	return bbr3_sndbuf_expand(sk);
+}
+
+SEC("struct_ops")
+void BPF_PROG(bbr3_bpf_cwnd_event, struct sock *sk, enum tcp_ca_event event)
+{
+	bbr3_cwnd_event(sk, event);
+}
+
+SEC("struct_ops")
+u32 BPF_PROG(bbr3_bpf_min_tso_segs, struct sock *sk)
+{
+	return bbr3_min_tso_segs(sk);
+}
+
+SEC(".struct_ops.link")
+struct tcp_congestion_ops bbr3_bpf = {
+	.init		= (void *)bbr3_bpf_init,
+	.cong_control	= (void *)bbr3_bpf_main,
+	.ssthresh	= (void *)bbr3_bpf_ssthresh,
+	.undo_cwnd	= (void *)bbr3_bpf_undo_cwnd,
+	.sndbuf_expand	= (void *)bbr3_bpf_sndbuf_expand,
+	.cwnd_event	= (void *)bbr3_bpf_cwnd_event,
+	.min_tso_segs	= (void *)bbr3_bpf_min_tso_segs,
+	.name		= "bbr3_bpf",
+};
@@ -43,7 +43,7 @@ echo "====== BBR3 KERNEL MODULE INSTALLER ======"
 print_status "Installing BBR3 congestion control module..."
 
 # Check for required files
-REQUIRED_FILES=("tcp_bbr3.c" "Makefile" "dkms.conf")
+REQUIRED_FILES=("tcp_bbr3.c" "tcp_bbr3.h" "tcp_bbr3_trace.h" "Makefile" "dkms.conf")
 for file in "${REQUIRED_FILES[@]}"; do
     if [ ! -f "$file" ]; then
         print_error "Required file $file not found in $SCRIPT_DIR"
@@ -116,7 +116,7 @@ install_with_dkms() {
     mkdir -p "$DKMS_DIR"
     
     # Copy source files
-    cp tcp_bbr3.c Makefile dkms.conf "$DKMS_DIR/"
+    cp tcp_bbr3.c tcp_bbr3.h tcp_bbr3_trace.h Makefile dkms.conf "$DKMS_DIR/"
     
     # Add to DKMS
     print_status "Adding module to DKMS..."
@@ -0,0 +1,156 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/* Per-ACK trace records, in the key=value layout of the bbr3_ack
+ * tracepoint's TP_printk() in ../tcp_bbr3_trace.h. Lines are matched on the
+ * event name, so ftrace's trace_pipe and "perf script" output parse as they
+ * are, with their per-line prefixes.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "ack_trace.h"
+
+#define ACK_EVENT	"bbr3_ack: "
+
+enum { F_U64, F_U32, F_S32, F_LONG };
+
+#define FIELD(_name, _type)	{ #_name, offsetof(struct ack_rec, _name), _type }
+
+/* In TP_printk() order */
+static const struct {
+	const char *name;
+	size_t offset;
+	int type;
+} fields[] = {
+	FIELD(cookie, F_U64),
+	FIELD(mstamp, F_U64),
+	FIELD(delivered_mstamp, F_U64),
+	FIELD(delivered, F_U32),
+	FIELD(delivered_ce, F_U32),
+	FIELD(lost, F_U32),
+	FIELD(app_limited, F_U32),
+	FIELD(inflight, F_U32),
+	FIELD(srtt_us, F_U32),
+	FIELD(mss, F_U32),
+	FIELD(cwnd, F_U32),
+	FIELD(ca_state, F_U32),
+	FIELD(cwnd_limited, F_U32),
+	FIELD(rwnd_limited, F_U32),
+	FIELD(rs_acked_sacked, F_U32),
+	FIELD(rs_delivered, F_S32),
+	FIELD(rs_prior_delivered, F_U32),
+	FIELD(rs_interval_us, F_LONG),
+	FIELD(rs_rtt_us, F_LONG),
+	FIELD(rs_losses, F_S32),
+	FIELD(rs_prior_in_flight, F_U32),
+	FIELD(rs_app_limited, F_U32),
+	FIELD(rs_ack_delayed, F_U32),
+};
+
+/* As the tracepoint's TP_fast_assign() */
+void ack_rec_capture(struct ack_rec *r, struct sock *sk,
+		     const struct rate_sample *rs, u64 cookie)
+{
+	const struct tcp_sock *tp = tcp_sk(sk);
+
+	r->cookie = cookie;
+	r->mstamp = tp->tcp_mstamp;
+	r->delivered_mstamp = tp->delivered_mstamp;
+	r->delivered = tp->delivered;
+	r->delivered_ce = tp->delivered_ce;
+	r->lost = tp->lost;
+	r->app_limited = tp->app_limited;
+	r->inflight = tcp_packets_in_flight(tp);
+	r->srtt_us = tp->srtt_us;
+	r->mss = tp->mss_cache;
+	r->cwnd = tp->snd_cwnd;
+	r->ca_state = inet_csk(sk)->icsk_ca_state;
+	r->cwnd_limited = tp->is_cwnd_limited;
+	r->rwnd_limited = tp->chrono_type == TCP_CHRONO_RWND_LIMITED;
+	r->rs_acked_sacked = rs->acked_sacked;
+	r->rs_delivered = rs->delivered;
+	r->rs_prior_delivered = rs->prior_delivered;
+	r->rs_interval_us = rs->interval_us;
+	r->rs_rtt_us = rs->rtt_us;
+	r->rs_losses = rs->losses;
+	r->rs_prior_in_flight = rs->prior_in_flight;
+	r->rs_app_limited = rs->is_app_limited;
+	r->rs_ack_delayed = rs->is_ack_delayed;
+}
+
+void ack_rec_write(FILE *f, const struct ack_rec *r)
+{
+	unsigned int i;
+
+	fputs(ACK_EVENT, f);
+	for (i = 0; i < ARRAY_SIZE(fields); i++) {
+		const void *p = (const char *)r + fields[i].offset;
+
+		fprintf(f, i ? " %s=" : "%s=", fields[i].name);
+		switch (fields[i].type) {
+		case F_U64:
+			fprintf(f, "%llu", (unsigned long long)*(const u64 *)p);
+			break;
+		case F_U32:
+			fprintf(f, "%u", *(const u32 *)p);
+			break;
+		case F_S32:
+			fprintf(f, "%d", *(const s32 *)p);
+			break;
+		case F_LONG:
+			fprintf(f, "%ld", *(const long *)p);
+			break;
+		}
+	}
+	fputc('\n', f);
+}
+
+int ack_rec_parse(const char *line, struct ack_rec *r)
+{
+	const char *p = strstr(line, ACK_EVENT);
+	unsigned long seen = 0;
+	unsigned int i;
+
+	if (!p)
+		return -ENOENT;
+	memset(r, 0, sizeof(*r));
+	p += strlen(ACK_EVENT);
+	while (*p && *p != '\n') {
+		const char *eq = strchr(p, '=');
+		char *end;
+		void *v;
+
+		if (!eq)
+			return -EINVAL;
+		for (i = 0; i < ARRAY_SIZE(fields); i++)
+			if (strlen(fields[i].name) == (size_t)(eq - p) &&
+			    !strncmp(fields[i].name, p, eq - p))
+				break;
+		if (i == ARRAY_SIZE(fields))
+			return -EINVAL;
+		v = (char *)r + fields[i].offset;
+		errno = 0;
+		switch (fields[i].type) {
+		case F_U64:
+			*(u64 *)v = strtoull(eq + 1, &end, 10);
+			break;
+		case F_U32:
+			*(u32 *)v = strtoul(eq + 1, &end, 10);
+			break;
+		case F_S32:
+			*(s32 *)v = strtol(eq + 1, &end, 10);
+			break;
+		default:
+			*(long *)v = strtol(eq + 1, &end, 10);
+			break;
+		}
+		if (end == eq + 1 || errno || (*end && *end != ' ' && *end != '\n'))
+			return -EINVAL;
+		seen |= 1UL << i;
+		p = end;
+		while (*p == ' ')
+			p++;
+	}
+	return seen == (1UL << ARRAY_SIZE(fields)) - 1 ? 0 : -EINVAL;
+}
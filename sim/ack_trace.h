@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/* Per-ACK traces: the tcp_bbr3:bbr3_ack tracepoint's records, as written by
+ * "bbr3_sim -w" and the kernel's trace buffer, and read by bbr3_replay.
+ */
+#ifndef ACK_TRACE_H
+#define ACK_TRACE_H
+
+#include <stdio.h>
+
+#include "sim_tcp.h"
+
+/* One bbr3_ack event: cong_control's inputs on one ACK */
+struct ack_rec {
+	u64 cookie;
+	u64 mstamp;
+	u64 delivered_mstamp;
+	u32 delivered;
+	u32 delivered_ce;
+	u32 lost;
+	u32 app_limited;
+	u32 inflight;
+	u32 srtt_us;
+	u32 mss;
+	u32 cwnd;		/* before the ACK; not an input */
+	u32 ca_state;
+	u32 cwnd_limited;
+	u32 rwnd_limited;
+	u32 rs_acked_sacked;
+	s32 rs_delivered;
+	u32 rs_prior_delivered;
+	long rs_interval_us;
+	long rs_rtt_us;
+	s32 rs_losses;
+	u32 rs_prior_in_flight;
+	u32 rs_app_limited;
+	u32 rs_ack_delayed;
+};
+
+void ack_rec_capture(struct ack_rec *r, struct sock *sk,
+		     const struct rate_sample *rs, u64 cookie);
+void ack_rec_write(FILE *f, const struct ack_rec *r);
+/* 0, -ENOENT if the line holds no bbr3_ack event, -EINVAL if malformed */
+int ack_rec_parse(const char *line, struct ack_rec *r);
+
+/* Load a record into a socket and rate sample, replay's inner loop. The
+ * recorded inflight is all in packets_out: the model only sees the sum.
+ */
+static inline void ack_rec_apply(const struct ack_rec *r, struct sock *sk,
+				 struct rate_sample *rs)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+
+	jiffies = r->mstamp / (USEC_PER_SEC / HZ);
+	tp->tcp_mstamp = r->mstamp;
+	tp->delivered_mstamp = r->delivered_mstamp;
+	tp->delivered = r->delivered;
+	tp->delivered_ce = r->delivered_ce;
+	tp->lost = r->lost;
+	tp->app_limited = r->app_limited;
+	tp->packets_out = r->inflight;
+	tp->srtt_us = r->srtt_us;
+	tp->mss_cache = r->mss;
+	tp->inet_conn.icsk_ca_state = r->ca_state;
+	tp->is_cwnd_limited = r->cwnd_limited;
+	tp->chrono_type = r->rwnd_limited ? TCP_CHRONO_RWND_LIMITED :
+					    TCP_CHRONO_BUSY;
+	rs->acked_sacked = r->rs_acked_sacked;
+	rs->delivered = r->rs_delivered;
+	rs->prior_delivered = r->rs_prior_delivered;
+	rs->interval_us = r->rs_interval_us;
+	rs->rtt_us = r->rs_rtt_us;
+	rs->losses = r->rs_losses;
+	rs->prior_in_flight = r->rs_prior_in_flight;
+	rs->is_app_limited = r->rs_app_limited;
+	rs->is_ack_delayed = r->rs_ack_delayed;
+}
+
+#endif /* ACK_TRACE_H */
@@ -0,0 +1,326 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/* Per-ACK cost micro-benchmark for the congestion controls in tcp_bbr3.c
+ *
+ * Replays bbr3_ack traces through cong_control (cong_avoid for Reno) in a
+ * tight loop and reports, per ACK, the time, 64-bit divisions (a library
+ * call on 32-bit hosts), cycles, instructions, cache misses and branch
+ * mispredictions. The time is that of the fastest pass,
+ * the least disturbed by the rest of the host; counters are averaged. Traces come from "bbr3_sim -w" or from
+ * the tcp_bbr3:bbr3_ack tracepoint of a production host (see
+ * ack_trace.c for the formats read).
+ *
+ * The replay is open loop: each ACK is handed the socket state recorded with
+ * it whatever the model did with the ones before, so every cc sees the same
+ * inputs. Only the per-ACK hook runs; ssthresh, cwnd_event and the like are
+ * rare enough not to matter. The "(replay)" row is the loop itself, with a
+ * cong_control that does nothing. A digest of the cwnd and pacing rate
+ * after each ACK tells whether two builds of the model behave alike on a
+ * trace, e.g. before and after an optimization.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ack_trace.h"
+#include "counters.h"
+#include "sim_env.h"
+
+#define NSEC_PER_SEC	1000000000ULL
+#define MAX_CCS		16
+#define MIN_ACKS	(5 * 1000 * 1000)	/* per cc, for the default -n */
+
+static struct ack_rec *recs;
+static u32 *rec_sock;		/* socket index of each record */
+static size_t nrecs;
+static struct tcp_sock *socks;
+static u32 nsocks;
+
+/* ---------------- trace loading ---------------- */
+
+struct cookie_ref {
+	u64 cookie;
+	size_t rec;
+};
+
+static int cookie_cmp(const void *a, const void *b)
+{
+	const struct cookie_ref *x = a, *y = b;
+
+	if (x->cookie != y->cookie)
+		return x->cookie < y->cookie ? -1 : 1;
+	return x->rec < y->rec ? -1 : x->rec > y->rec;
+}
+
+static int load_trace(const char *path)
+{
+	struct cookie_ref *refs;
+	size_t cap = 0, lineno = 0, len = 0, i;
+	char *line = NULL;
+	FILE *f;
+	int err;
+
+	f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -errno;
+	}
+	while (getline(&line, &len, f) > 0) {
+		lineno++;
+		if (nrecs == cap) {
+			cap = cap ? 2 * cap : 4096;
+			recs = realloc(recs, cap * sizeof(*recs));
+			if (!recs)
+				abort();
+		}
+		err = ack_rec_parse(line, &recs[nrecs]);
+		if (err == -ENOENT)
+			continue;
+		if (err) {
+			fprintf(stderr, "%s:%zu: malformed bbr3_ack event\n",
+				path, lineno);
+			goto out;
+		}
+		nrecs++;
+	}
+	err = 0;
+	if (!nrecs) {
+		fprintf(stderr, "%s: no bbr3_ack events\n", path);
+		err = -ENOENT;
+		goto out;
+	}
+
+	/* One socket per cookie, numbered by first appearance in the sort */
+	refs = malloc(nrecs * sizeof(*refs));
+	rec_sock = malloc(nrecs * sizeof(*rec_sock));
+	if (!refs || !rec_sock)
+		abort();
+	for (i = 0; i < nrecs; i++)
+		refs[i] = (struct cookie_ref){ recs[i].cookie, i };
+	qsort(refs, nrecs, sizeof(*refs), cookie_cmp);
+	for (i = 0; i < nrecs; i++) {
+		if (i && refs[i].cookie != refs[i - 1].cookie)
+			nsocks++;
+		rec_sock[refs[i].rec] = nsocks;
+	}
+	nsocks++;
+	free(refs);
+	socks = aligned_alloc(64, ((nsocks * sizeof(*socks) + 63) & ~63UL));
+	if (!socks)
+		abort();
+out:
+	free(line);
+	fclose(f);
+	return err;
+}
+
+/* ---------------- replay ---------------- */
+
+static void noop_cong_control(struct sock *sk, const struct rate_sample *rs)
+{
+}
+
+static void noop_init(struct sock *sk)
+{
+}
+
+static struct tcp_congestion_ops replay_noop = {
+	.name		= "(replay)",
+	.init		= noop_init,
+	.cong_control	= noop_cong_control,
+};
+
+/* A fresh connection per socket, as the stack hands it to init, at the
+ * time of its first ACK
+ */
+static void socks_init(const struct tcp_congestion_ops *ops)
+{
+	struct rate_sample rs;
+	size_t i;
+	u32 n = 0;
+
+	memset(socks, 0, nsocks * sizeof(*socks));
+	for (i = 0; i < nrecs && n < nsocks; i++) {
+		struct tcp_sock *tp = &socks[rec_sock[i]];
+		struct sock *sk = (struct sock *)tp;
+
+		if (tp->inet_conn.icsk_ca_ops)
+			continue;
+		sk->sk_state = TCP_ESTABLISHED;
+		sk->sk_family = AF_INET;
+		sk->sk_daddr = rec_sock[i] + 1;
+		sk->sk_max_pacing_rate = ~0UL;
+		sk->sk_pacing_shift = 10;
+		sk->sk_gso_max_size = GSO_MAX_SIZE;
+		tp->snd_cwnd = TCP_INIT_CWND;
+		tp->snd_cwnd_clamp = ~0U;
+		tp->snd_ssthresh = TCP_INFINITE_SSTHRESH;
+		ack_rec_apply(&recs[i], sk, &rs);
+		tp->inet_conn.icsk_ca_ops = ops;
+		ops->init(sk);
+		n++;
+	}
+}
+
+static void socks_release(const struct tcp_congestion_ops *ops)
+{
+	u32 i;
+
+	if (!ops->release)
+		return;
+	for (i = 0; i < nsocks; i++)
+		ops->release((struct sock *)&socks[i]);
+}
+
+/* Returns the FNV-1a digest of cwnd and pacing rate if asked for one */
+static __always_inline u64 replay(const struct tcp_congestion_ops *ops,
+				  const bool digest)
+{
+	struct rate_sample rs = { 0 };
+	u64 h = 0xcbf29ce484222325ULL;
+	size_t i;
+
+	for (i = 0; i < nrecs; i++) {
+		struct sock *sk = (struct sock *)&socks[rec_sock[i]];
+
+		ack_rec_apply(&recs[i], sk, &rs);
+		if (ops->cong_control)
+			ops->cong_control(sk, &rs);
+		else
+			ops->cong_avoid(sk, 0, rs.acked_sacked);
+		if (digest) {
+			h = (h ^ tcp_sk(sk)->snd_cwnd) * 0x100000001b3ULL;
+			h = (h ^ sk->sk_pacing_rate) * 0x100000001b3ULL;
+		}
+	}
+	return h;
+}
+
+/* ---------------- driver ---------------- */
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void bench(const struct tcp_congestion_ops *ops, unsigned int passes)
+{
+	double acks = (double)nrecs * passes;
+	u64 digest, ns, best = ~0ULL;
+	unsigned long divs;
+	unsigned int p, i;
+
+	/* An untimed pass for the digest, which also warms the caches */
+	socks_init(ops);
+	digest = replay(ops, true);
+	socks_release(ops);
+
+	counters_reset();
+	divs = sim_div64s;
+	for (p = 0; p < passes; p++) {
+		socks_init(ops);
+		counters_enable(true);
+		ns = now_ns();
+		replay(ops, false);
+		best = min(best, now_ns() - ns);
+		counters_enable(false);
+		socks_release(ops);
+	}
+	divs = sim_div64s - divs;
+
+	printf("%-10s %8.2f %7.3f", ops->name, (double)best / nrecs,
+	       divs / acks);
+	for (i = 0; i < CNT_MAX; i++) {
+		unsigned long long val;
+
+		if (counter_read(i, &val))
+			printf(" %10.3f", val / acks);
+		else
+			printf(" %10s", "-");
+	}
+	printf("  %016llx\n", (unsigned long long)digest);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-c cc]... [-n passes] [-p param=value]... trace\n"
+		"\n"
+		"Replays a bbr3_ack trace through each cc (default: bbr3_v1,\n"
+		"bbr3_v2, bbr3_v3 and reno) and prints the cost per ACK.\n",
+		prog);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	static const char * const default_ccs[] = {
+		"bbr3_v1", "bbr3_v2", "bbr3_v3", "reno",
+	};
+	const char *ccs[MAX_CCS];
+	unsigned int nccs = 0, passes = 0, i;
+	int opt, err;
+
+	while ((opt = getopt(argc, argv, "c:n:p:h")) != -1) {
+		switch (opt) {
+		case 'c':
+			if (nccs == MAX_CCS)
+				usage(argv[0]);
+			ccs[nccs++] = optarg;
+			break;
+		case 'n':
+			passes = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			err = set_param(optarg);
+			if (err) {
+				fprintf(stderr, "bad parameter %s: %s\n",
+					optarg, strerror(-err));
+				return 2;
+			}
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1)
+		usage(argv[0]);
+	if (!nccs)
+		for (; nccs < ARRAY_SIZE(default_ccs); nccs++)
+			ccs[nccs] = default_ccs[nccs];
+
+	tcp_register_congestion_control(&sim_reno);
+	err = sim_module_init();
+	if (err) {
+		fprintf(stderr, "module init failed: %d\n", err);
+		return 1;
+	}
+	for (i = 0; i < nccs; i++) {
+		if (!ca_find(ccs[i])) {
+			fprintf(stderr, "unknown congestion control %s\n",
+				ccs[i]);
+			return 2;
+		}
+	}
+	if (load_trace(argv[optind]))
+		return 1;
+	if (!passes)
+		passes = (MIN_ACKS + nrecs - 1) / nrecs;
+
+	counters_open();
+	printf("%s: %zu ACKs on %u sockets, %u passes\n", argv[optind], nrecs,
+	       nsocks, passes);
+	printf("%-10s %8s %7s", "cc", "ns/ack", "div64");
+	for (i = 0; i < CNT_MAX; i++)
+		printf(" %10s", counter_names[i]);
+	printf("  digest\n");
+
+	bench(&replay_noop, passes);
+	for (i = 0; i < nccs; i++)
+		bench(ca_find(ccs[i]), passes);
+	return 0;
+}
@@ -0,0 +1,1310 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/* Userspace discrete-event simulator for tcp_bbr3.c
+ *
+ * tcp_bbr3.c is compiled unmodified against the stand-in headers in
+ * include/ and driven by a packet-level model of a single bottleneck:
+ *
+ *   senders --> [policer] --> FIFO queue --> link --> receivers
+ *      ^                                                  |
+ *      +--------------------- ACKs -----------------------+
+ *
+ * The sender side mimics what the kernel hands a congestion control module:
+ * per-ACK rate samples (as in tcp_rate.c), RACK-style loss detection,
+ * Open/Recovery/Loss states, RTOs, app-limited marking and CA_EVENT_TX_START.
+ * Scenarios cover buffer depths, bandwidth and RTT step changes, competing
+ * flows, random loss, policers, ECN, app-limited, on/off and receive window
+ * limited senders, stretch ACKs up to the 44 packets of a 64KB GRO batch,
+ * and connections live-migrated in TCP_REPAIR mode.
+ * Each reports link utilization, per-flow throughput, p50/p99 queueing
+ * delay, loss rate and Jain's fairness index, and with Reno flows mixed in,
+ * the throughput of the cc under test over its fair share. Runs
+ * are deterministic for a given seed (-S).
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "ack_trace.h"
+#include "sim_env.h"
+
+#define NSEC_PER_SEC	1000000000ULL
+#define MSS		1448
+#define PKT_BYTES	(MSS + 52)	/* wire size incl. TCP/IP headers */
+#define MAX_FLOWS	16
+#define MAX_ACK_BATCH	64
+#define DELAY_BIN_US	10
+#define DELAY_BINS	(10 * 1000 * 1000 / DELAY_BIN_US)	/* 10s */
+
+static u64 now_ns;
+static u64 trace_ns;	/* -t: dump flow state at this interval */
+static bool dump_proc;	/* -s: print the module's /proc files at exit */
+static FILE *ack_trace;	/* -w: bbr3_ack records of every ACK */
+static u64 next_cookie;
+
+/* ---------------- randomness ---------------- */
+
+static double rng_uniform(void)
+{
+	return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* ---------------- event queue ---------------- */
+
+enum ev_type {
+	EV_LINK_DONE,		/* head of the bottleneck queue is on the wire */
+	EV_RX,			/* data packet reaches its receiver */
+	EV_ACK,			/* ACK reaches its sender */
+	EV_SEND,		/* pacing timer */
+	EV_RTO,
+	EV_DELACK,
+	EV_RATE,		/* bottleneck rate change */
+	EV_RTT,			/* path RTT change */
+	EV_START,
+	EV_STOP,
+	EV_MIGRATE,
+	EV_TRACE,
+};
+
+struct ack_batch {
+	int n;
+	u32 seq[MAX_ACK_BATCH];
+	u64 tx_ns[MAX_ACK_BATCH];
+	bool ce[MAX_ACK_BATCH];
+};
+
+struct event {
+	u64 t;
+	u64 order;		/* FIFO among events due at the same time */
+	int type;
+	int flow;
+	u32 seq;
+	bool ce;
+	u64 tx_ns;
+	u64 aux;
+	struct ack_batch *ack;
+};
+
+static struct event *heap;
+static size_t heap_len, heap_cap;
+static u64 ev_order;
+
+static bool ev_before(const struct event *a, const struct event *b)
+{
+	return a->t < b->t || (a->t == b->t && a->order < b->order);
+}
+
+static void ev_push(struct event e)
+{
+	size_t i;
+
+	if (heap_len == heap_cap) {
+		heap_cap = heap_cap ? heap_cap * 2 : 4096;
+		heap = realloc(heap, heap_cap * sizeof(*heap));
+		if (!heap)
+			abort();
+	}
+	e.order = ev_order++;
+	for (i = heap_len++; i; i = (i - 1) / 2) {
+		if (!ev_before(&e, &heap[(i - 1) / 2]))
+			break;
+		heap[i] = heap[(i - 1) / 2];
+	}
+	heap[i] = e;
+}
+
+static struct event ev_pop(void)
+{
+	struct event top = heap[0], last = heap[--heap_len];
+	size_t i = 0, c;
+
+	while ((c = 2 * i + 1) < heap_len) {
+		if (c + 1 < heap_len && ev_before(&heap[c + 1], &heap[c]))
+			c++;
+		if (!ev_before(&heap[c], &last))
+			break;
+		heap[i] = heap[c];
+		i = c;
+	}
+	heap[i] = last;
+	return top;
+}
+
+static void ev_at(u64 t, int type, int flow)
+{
+	ev_push((struct event){ .t = t, .type = type, .flow = flow });
+}
+
+/* ---------------- scenario description ---------------- */
+
+struct flow_cfg {
+	const char *cc;
+	u32 rtt_us;
+	double start_s;
+	double stop_s;		/* 0: runs to the end */
+	double app_mbps;	/* 0: bulk transfer */
+	double burst_kb;	/* or write burst_kb every period_ms, then idle */
+	double period_ms;
+	double conn_kb;		/* close after conn_kb and reconnect, 0: one
+				 * connection */
+	int ack_every;		/* receiver ACKs every N packets */
+	double rwnd_kb;		/* receive window, 0: unlimited */
+	double rwnd_open_s;	/*   until rwnd_open_s, 0: for good */
+	bool ecn;
+	double migrate_s;	/* move the connection to another host */
+	bool migrate_cold;	/*   without its checkpoint */
+};
+
+struct scenario {
+	const char *name;
+	const char *desc;
+	double mbps;
+	u32 rtt_us;		/* base RTT used for BDP-relative buffers */
+	double buf_bdp;		/* bottleneck buffer in BDPs */
+	double loss;		/* random loss probability at the bottleneck */
+	double policer_mbps;	/* token bucket ahead of the queue, 0: off */
+	double ecn_k_bdp;	/* CE-mark above this queue depth, 0: off */
+	double step_s;		/* at step_s the rate becomes step_mbps */
+	double step_mbps;
+	double duration_s;
+	double warmup_s;	/* excluded from the metrics */
+	int nflows;
+	struct flow_cfg flows[MAX_FLOWS];
+	double rtt_step_s;	/* at rtt_step_s every path's RTT becomes */
+	u32 rtt_step_us;	/*   rtt_step_us (a route change) */
+};
+
+#define BULK(c, r)	{ .cc = (c), .rtt_us = (r) }
+
+static const struct scenario scenarios[] = {
+	{ "single", "one flow, 100Mbit 40ms, 1 BDP buffer",
+	  100, 40000, 1, 0, 0, 0, 0, 0, 20, 5, 1, { BULK(NULL, 40000) } },
+	{ "shallow", "one flow, 0.1 BDP buffer",
+	  100, 40000, 0.1, 0, 0, 0, 0, 0, 20, 5, 1, { BULK(NULL, 40000) } },
+	{ "deep", "one flow, 10 BDP buffer",
+	  100, 40000, 10, 0, 0, 0, 0, 0, 20, 5, 1, { BULK(NULL, 40000) } },
+	{ "lossy", "one flow, 1% random loss",
+	  100, 40000, 1, 0.01, 0, 0, 0, 0, 20, 5, 1, { BULK(NULL, 40000) } },
+	{ "policer", "one flow through a 30Mbit token-bucket policer",
+	  100, 40000, 1, 0, 30, 0, 0, 0, 30, 10, 1, { BULK(NULL, 40000) } },
+	{ "stepdown", "one flow, bottleneck drops to 20Mbit at 10s",
+	  100, 40000, 1, 0, 0, 0, 10, 20, 30, 12, 1, { BULK(NULL, 40000) } },
+	{ "stepup", "one flow, bottleneck grows to 200Mbit at 10s",
+	  100, 40000, 1, 0, 0, 0, 10, 200, 30, 12, 1, { BULK(NULL, 40000) } },
+	{ "rttup", "one flow, path RTT grows from 10ms to 40ms at 10s",
+	  100, 40000, 1, 0, 0, 0, 0, 0, 30, 12, 1, { BULK(NULL, 10000) },
+	  .rtt_step_s = 10, .rtt_step_us = 40000 },
+	{ "rttdown", "one flow, path RTT drops from 40ms to 10ms at 10s",
+	  100, 40000, 1, 0, 0, 0, 0, 0, 30, 12, 1, { BULK(NULL, 40000) },
+	  .rtt_step_s = 10, .rtt_step_us = 10000 },
+	{ "ecn", "one ECN flow, 2ms RTT, CE above 0.5 BDP",
+	  1000, 2000, 2, 0, 0, 0.5, 0, 0, 10, 2, 1,
+	  { { .rtt_us = 2000, .ecn = true } } },
+	{ "dc", "eight flows, 10Gbit 100-200us, CE above 0.2 BDP if negotiated",
+	  10000, 100, 4, 0, 0, 0.2, 0, 0, 5, 1, 8,
+	  { BULK(NULL, 100), { .rtt_us = 200, .start_s = 0.1 },
+	    { .rtt_us = 100, .start_s = 0.2 }, { .rtt_us = 200, .start_s = 0.3 },
+	    { .rtt_us = 100, .start_s = 0.4 }, { .rtt_us = 200, .start_s = 0.5 },
+	    { .rtt_us = 100, .start_s = 0.6 }, { .rtt_us = 200, .start_s = 0.7 } } },
+	{ "fairness", "four staggered flows, same RTT",
+	  100, 40000, 1, 0, 0, 0, 0, 0, 40, 20, 4,
+	  { BULK(NULL, 40000),
+	    { .rtt_us = 40000, .start_s = 2 },
+	    { .rtt_us = 40000, .start_s = 4 },
+	    { .rtt_us = 40000, .start_s = 6 } } },
+	{ "rttfair", "two flows, 10ms and 80ms RTT",
+	  100, 40000, 1, 0, 0, 0, 0, 0, 40, 15, 2,
+	  { BULK(NULL, 10000), BULK(NULL, 80000) } },
+	{ "vs_reno", "one flow against one Reno flow, 2 BDP buffer",
+	  100, 40000, 2, 0, 0, 0, 0, 0, 40, 15, 2,
+	  { BULK(NULL, 40000), BULK("reno", 40000) } },
+	{ "vs_reno3", "one flow against three Reno flows, 0.25 BDP buffer",
+	  100, 40000, 0.25, 0, 0, 0, 0, 0, 60, 20, 4,
+	  { BULK(NULL, 40000), BULK("reno", 40000), BULK("reno", 40000),
+	    BULK("reno", 40000) } },
+	{ "reno_deep", "one flow against one Reno flow, 4 BDP buffer",
+	  100, 40000, 4, 0, 0, 0, 0, 0, 60, 20, 2,
+	  { BULK(NULL, 40000), BULK("reno", 40000) } },
+	{ "applimited", "one 20Mbit app-limited flow and one bulk flow",
+	  100, 40000, 1, 0, 0, 0, 0, 0, 30, 10, 2,
+	  { { .rtt_us = 40000, .app_mbps = 20 }, BULK(NULL, 40000) } },
+	{ "idle", "one flow sending 1MB every 500ms, idle in between",
+	  100, 40000, 1, 0, 0, 0, 0, 0, 30, 10, 1,
+	  { { .rtt_us = 40000, .burst_kb = 1024, .period_ms = 500 } } },
+	{ "rpc", "back to back 1MB connections, one RTT handshake each",
+	  100, 40000, 1, 0, 0, 0, 0, 0, 30, 5, 1,
+	  { { .rtt_us = 40000, .conn_kb = 1024 } } },
+	{ "idle_short", "16KB every 20ms against a bulk flow, 8 BDP buffer",
+	  100, 10000, 8, 0, 0, 0, 0, 0, 30, 10, 2,
+	  { { .rtt_us = 10000, .burst_kb = 16, .period_ms = 20 },
+	    BULK(NULL, 10000) } },
+	{ "rwnd", "one flow, 128KB receive window until 10s, then unlimited",
+	  100, 40000, 1, 0, 0, 0, 0, 0, 20, 5, 1,
+	  { { .rtt_us = 40000, .rwnd_kb = 128, .rwnd_open_s = 10 } } },
+	{ "stretch", "one flow, receiver ACKs every 8 packets",
+	  100, 40000, 1, 0, 0, 0, 0, 0, 20, 5, 1,
+	  { { .rtt_us = 40000, .ack_every = 8 } } },
+	{ "gro", "one flow, 1Gbit 1ms, receiver ACKs every 44 packets (64KB)",
+	  1000, 1000, 1, 0, 0, 0, 0, 0, 10, 2, 1,
+	  { { .rtt_us = 1000, .ack_every = 44 } } },
+	{ "migrate", "one flow, live-migrated at 10s with its checkpoint",
+	  100, 40000, 1, 0, 0, 0, 0, 0, 20, 5, 1,
+	  { { .rtt_us = 40000, .migrate_s = 10 } } },
+	{ "migrate_cold", "one flow, live-migrated at 10s without its checkpoint",
+	  100, 40000, 1, 0, 0, 0, 0, 0, 20, 5, 1,
+	  { { .rtt_us = 40000, .migrate_s = 10, .migrate_cold = true } } },
+};
+
+/* ---------------- flows ---------------- */
+
+enum {
+	SEG_SACKED	= 1 << 0,
+	SEG_LOST	= 1 << 1,
+	SEG_RETRANS	= 1 << 2,
+};
+
+struct seg {
+	u64 tx_ns;
+	u64 first_tx_us;	/* tcp_rate.c: send time of the first packet */
+	u64 delivered_us;	/*   in the flight and tp->delivered_mstamp */
+	u32 delivered;		/*   and tp->delivered when this one was sent */
+	u8 flags;
+	bool app_limited;
+};
+
+struct txq_ent {
+	u32 seq;
+	u64 tx_ns;
+};
+
+struct flow {
+	struct tcp_sock tp;	/* must be first: sk == &tp */
+	const struct flow_cfg *cfg;
+	const struct tcp_congestion_ops *ops;
+	bool active;
+	bool ecn;		/* negotiated: the cc or the scenario asked */
+	u32 rtt_us;		/* current base RTT of the path */
+	u64 cookie;		/* of the current connection, for -w */
+
+	struct seg *segs;
+	u32 nsegs_cap;
+	u32 snd_una, snd_nxt;
+	struct txq_ent *txq;	/* outstanding transmissions, in send order */
+	u32 txq_cap, txq_head, txq_tail;
+	u32 *rtxq;		/* lost segments awaiting retransmission */
+	u32 rtxq_cap, rtxq_head, rtxq_tail;
+
+	u64 first_tx_us;
+	u64 next_send_ns;
+	u64 send_ev_ns;		/* pending EV_SEND, 0 if none */
+	u64 rto_deadline_ns;
+	bool rto_armed;
+	u64 rack_tx_ns;		/* send time of the newest delivered packet */
+	u32 high_seq;		/* recovery ends when snd_una passes this */
+	u32 rttvar_us;
+	bool cwnd_limited_now;
+	u32 cwnd_window_end;
+
+	double app_bytes;	/* app-limited sources: bytes queued to send */
+	u64 app_stamp_ns;
+	u32 conn_end;		/* conn_kb sources: end of this connection */
+
+	/* receiver */
+	struct ack_batch *pending;
+	bool delack_armed;
+
+	/* metrics */
+	u64 bytes_acked;
+	u64 sent, retrans, spurious, rtos, conns;
+};
+
+static struct flow flows[MAX_FLOWS];
+static int nflows;
+static const struct scenario *sc;
+static const char *default_cc = "bbr3";
+
+static struct {
+	double rate_bps;
+	u64 busy_until_ns;
+	struct qpkt {
+		int flow;
+		u32 seq;
+		u64 tx_ns;
+		u64 enq_ns;
+		bool ce;
+	} *q;
+	u32 q_cap, q_head, q_len;
+	u64 q_bytes, buf_bytes, ecn_k_bytes;
+	double tokens, policer_bps, policer_depth;
+	u64 policer_stamp_ns;
+	u64 drops, arrivals;
+	u64 rate_ns_total;	/* sum over time of the rate inside the window */
+	double cap_bytes;
+	u64 cap_stamp_ns;
+	u32 *delay_hist;
+	u64 delay_samples;
+} link;
+
+static struct sock *flow_sk(struct flow *f)
+{
+	return (struct sock *)&f->tp;
+}
+
+static u64 us_now(void)
+{
+	return now_ns / 1000;
+}
+
+static bool in_window(void)
+{
+	return now_ns >= (u64)(sc->warmup_s * NSEC_PER_SEC);
+}
+
+static struct seg *seg_get(struct flow *f, u32 seq)
+{
+	if (seq >= f->nsegs_cap) {
+		u32 cap = f->nsegs_cap ? f->nsegs_cap : 1 << 16;
+
+		while (cap <= seq)
+			cap *= 2;
+		f->segs = realloc(f->segs, cap * sizeof(*f->segs));
+		if (!f->segs)
+			abort();
+		memset(f->segs + f->nsegs_cap, 0,
+		       (cap - f->nsegs_cap) * sizeof(*f->segs));
+		f->nsegs_cap = cap;
+	}
+	return &f->segs[seq];
+}
+
+#define RING_PUSH(base, cap, head, tail, val) do {			\
+	if ((tail) - (head) == (cap)) {					\
+		u32 __ncap = (cap) ? (cap) * 2 : 1024, __i;		\
+		typeof(base) __n = malloc(__ncap * sizeof(*(base)));	\
+		if (!__n)						\
+			abort();					\
+		for (__i = 0; __i < (tail) - (head); __i++)		\
+			__n[__i] = (base)[((head) + __i) % (cap)];	\
+		free(base);						\
+		(base) = __n;						\
+		(tail) -= (head);					\
+		(head) = 0;						\
+		(cap) = __ncap;						\
+	}								\
+	(base)[(tail)++ % (cap)] = (val);				\
+} while (0)
+
+static void link_account(void)
+{
+	/* integrate the available capacity over the measurement window */
+	if (in_window()) {
+		u64 from = max(link.cap_stamp_ns,
+			       (u64)(sc->warmup_s * NSEC_PER_SEC));
+		double bps = link.rate_bps;
+
+		if (link.policer_bps)
+			bps = min(bps, link.policer_bps);
+		link.cap_bytes += bps / 8 * (now_ns - from) / NSEC_PER_SEC;
+	}
+	link.cap_stamp_ns = now_ns;
+}
+
+static void link_start_tx(void)
+{
+	struct qpkt *p = &link.q[link.q_head % link.q_cap];
+	u64 delay_us = (now_ns - p->enq_ns) / 1000;
+
+	if (in_window()) {
+		link.delay_hist[min_t(u64, delay_us / DELAY_BIN_US,
+				      DELAY_BINS - 1)]++;
+		link.delay_samples++;
+	}
+	link.busy_until_ns = now_ns +
+		(u64)(PKT_BYTES * 8 * (double)NSEC_PER_SEC / link.rate_bps);
+	ev_at(link.busy_until_ns, EV_LINK_DONE, p->flow);
+}
+
+static void link_enqueue(struct flow *f, u32 seq, u64 tx_ns)
+{
+	struct qpkt p = { f - flows, seq, tx_ns, now_ns, false };
+
+	link.arrivals++;
+	if (sc->loss && rng_uniform() < sc->loss)
+		goto drop;
+	if (link.policer_bps) {
+		link.tokens += link.policer_bps / 8 *
+			       (now_ns - link.policer_stamp_ns) / NSEC_PER_SEC;
+		link.tokens = min(link.tokens, link.policer_depth);
+		link.policer_stamp_ns = now_ns;
+		if (link.tokens < PKT_BYTES)
+			goto drop;
+		link.tokens -= PKT_BYTES;
+	}
+	if (link.q_bytes + PKT_BYTES > link.buf_bytes)
+		goto drop;
+	if (link.ecn_k_bytes && f->ecn && link.q_bytes > link.ecn_k_bytes)
+		p.ce = true;
+	if (link.q_len == link.q_cap) {
+		u32 ncap = link.q_cap ? link.q_cap * 2 : 1024, i;
+		struct qpkt *n = malloc(ncap * sizeof(*n));
+
+		if (!n)
+			abort();
+		for (i = 0; i < link.q_len; i++)
+			n[i] = link.q[(link.q_head + i) % link.q_cap];
+		free(link.q);
+		link.q = n;
+		link.q_head = 0;
+		link.q_cap = ncap;
+	}
+	link.q[(link.q_head + link.q_len++) % link.q_cap] = p;
+	link.q_bytes += PKT_BYTES;
+	if (link.q_len == 1 && link.busy_until_ns <= now_ns)
+		link_start_tx();
+	return;
+drop:
+	if (in_window())
+		link.drops++;
+}
+
+static void link_done(void)
+{
+	struct qpkt p = link.q[link.q_head % link.q_cap];
+	struct flow *f = &flows[p.flow];
+
+	link.q_head++;
+	link.q_len--;
+	link.q_bytes -= PKT_BYTES;
+	ev_push((struct event){ .t = now_ns + f->rtt_us * 500ULL,
+				.type = EV_RX, .flow = p.flow, .seq = p.seq,
+				.tx_ns = p.tx_ns, .ce = p.ce });
+	if (link.q_len)
+		link_start_tx();
+}
+
+/* ---------------- receiver ---------------- */
+
+static void rx_send_ack(struct flow *f)
+{
+	if (!f->pending || !f->pending->n)
+		return;
+	ev_push((struct event){ .t = now_ns + f->rtt_us * 500ULL,
+				.type = EV_ACK, .flow = f - flows,
+				.ack = f->pending });
+	f->pending = NULL;
+}
+
+static void rx_packet(struct flow *f, u32 seq, u64 tx_ns, bool ce)
+{
+	int every = f->cfg->ack_every ? f->cfg->ack_every : 1;
+	struct ack_batch *b;
+
+	if (!f->pending) {
+		f->pending = calloc(1, sizeof(*f->pending));
+		if (!f->pending)
+			abort();
+	}
+	b = f->pending;
+	b->seq[b->n] = seq;
+	b->tx_ns[b->n] = tx_ns;
+	b->ce[b->n] = ce;
+	if (++b->n >= min(every, MAX_ACK_BATCH)) {
+		rx_send_ack(f);
+	} else if (!f->delack_armed) {
+		f->delack_armed = true;
+		ev_at(now_ns + 2 * NSEC_PER_SEC / 1000, EV_DELACK, f - flows);
+	}
+}
+
+/* ---------------- sender ---------------- */
+
+static void flow_try_send(struct flow *f);
+
+static void set_ca_state(struct flow *f, u8 state)
+{
+	struct sock *sk = flow_sk(f);
+
+	if (f->ops->set_state)
+		f->ops->set_state(sk, state);
+	f->tp.inet_conn.icsk_ca_state = state;
+}
+
+static void arm_rto(struct flow *f)
+{
+	u32 rto_us = max(200000U, (f->tp.srtt_us >> 3) + 4 * f->rttvar_us);
+
+	f->rto_deadline_ns = now_ns + rto_us * 1000ULL;
+	if (!f->rto_armed) {
+		f->rto_armed = true;
+		ev_at(f->rto_deadline_ns, EV_RTO, f - flows);
+	}
+}
+
+static void mark_lost(struct flow *f, u32 seq)
+{
+	struct seg *s = seg_get(f, seq);
+
+	if (s->flags & (SEG_SACKED | SEG_LOST))
+		return;
+	s->flags |= SEG_LOST;
+	f->tp.lost++;
+	f->tp.packets_out--;
+	RING_PUSH(f->rtxq, f->rtxq_cap, f->rtxq_head, f->rtxq_tail, seq);
+}
+
+static bool app_limited_src(const struct flow *f)
+{
+	return f->cfg->app_mbps || f->cfg->period_ms;
+}
+
+static void app_refill(struct flow *f)
+{
+	u64 period = f->cfg->period_ms * NSEC_PER_MSEC;
+
+	if (period)
+		f->app_bytes += (double)(now_ns / period -
+					 f->app_stamp_ns / period) *
+				f->cfg->burst_kb * 1024;
+	else if (f->cfg->app_mbps)
+		f->app_bytes += f->cfg->app_mbps * 1e6 / 8 *
+				(now_ns - f->app_stamp_ns) / NSEC_PER_SEC;
+	else
+		return;
+	f->app_bytes = min(f->app_bytes, 64.0 * 1024 * 1024);
+	f->app_stamp_ns = now_ns;
+}
+
+/* Would one more new segment overrun the peer's receive window? */
+static bool rwnd_full(const struct flow *f)
+{
+	const struct flow_cfg *c = f->cfg;
+
+	if (!c->rwnd_kb ||
+	    (c->rwnd_open_s && now_ns >= c->rwnd_open_s * NSEC_PER_SEC))
+		return false;
+	return (u64)(f->snd_nxt + 1 - f->snd_una) * MSS > c->rwnd_kb * 1024;
+}
+
+static void transmit(struct flow *f, u32 seq, bool rtx)
+{
+	struct tcp_sock *tp = &f->tp;
+	struct seg *s = seg_get(f, seq);
+	u64 rate = f->tp.inet_conn.icsk_inet.sk_pacing_rate;
+
+	if (!tp->packets_out) {
+		/* tcp_rate_skb_sent(): restart the flight clock */
+		f->first_tx_us = us_now();
+		tp->delivered_mstamp = us_now();
+	}
+	s->tx_ns = now_ns;
+	s->first_tx_us = f->first_tx_us;
+	s->delivered_us = tp->delivered_mstamp;
+	s->delivered = tp->delivered;
+	s->app_limited = tp->app_limited != 0;
+	s->flags = (s->flags & ~SEG_LOST) | (rtx ? SEG_RETRANS : 0);
+	tp->packets_out++;
+	tp->lsndtime = tcp_jiffies32;
+	RING_PUSH(f->txq, f->txq_cap, f->txq_head, f->txq_tail,
+		  ((struct txq_ent){ seq, now_ns }));
+	if (in_window()) {
+		f->sent++;
+		f->retrans += rtx;
+	}
+	if (rate)
+		f->next_send_ns = now_ns + PKT_BYTES * NSEC_PER_SEC / rate;
+	if (!f->rto_armed)
+		arm_rto(f);
+	link_enqueue(f, seq, now_ns);
+}
+
+static void flow_try_send(struct flow *f)
+{
+	struct tcp_sock *tp = &f->tp;
+	struct sock *sk = flow_sk(f);
+
+	if (!f->active)
+		return;
+	for (;;) {
+		bool rtx = f->rtxq_head != f->rtxq_tail;
+		u32 seq;
+
+		if (tcp_packets_in_flight(tp) >= tp->snd_cwnd) {
+			tp->is_cwnd_limited = 1;
+			f->cwnd_limited_now = true;
+			return;
+		}
+		tp->chrono_type = TCP_CHRONO_BUSY;
+		if (f->next_send_ns > now_ns) {
+			if (!f->send_ev_ns || f->send_ev_ns > f->next_send_ns) {
+				f->send_ev_ns = f->next_send_ns;
+				ev_at(f->next_send_ns, EV_SEND, f - flows);
+			}
+			return;
+		}
+		app_refill(f);
+		if (!rtx && app_limited_src(f) && f->app_bytes < MSS) {
+			/* tcp_rate_check_app_limited() */
+			tp->app_limited = (tp->delivered +
+					   tcp_packets_in_flight(tp)) ? : 1;
+			if (!f->send_ev_ns) {
+				u64 period = f->cfg->period_ms * NSEC_PER_MSEC;
+				u64 wait = period ? period - now_ns % period :
+					   (MSS - f->app_bytes) * 8 *
+					   NSEC_PER_SEC / (f->cfg->app_mbps * 1e6);
+
+				f->send_ev_ns = now_ns + wait + 1;
+				ev_at(f->send_ev_ns, EV_SEND, f - flows);
+			}
+			return;
+		}
+		if (!rtx && rwnd_full(f)) {
+			/* tcp_write_xmit(): !tcp_snd_wnd_test() */
+			tp->chrono_type = TCP_CHRONO_RWND_LIMITED;
+			return;
+		}
+		if (!rtx && f->cfg->conn_kb && f->snd_nxt == f->conn_end) {
+			tp->app_limited = (tp->delivered +
+					   tcp_packets_in_flight(tp)) ? : 1;
+			return;
+		}
+		/* tcp_event_data_sent() */
+		if (!tcp_packets_in_flight(tp) && f->ops->cwnd_event)
+			f->ops->cwnd_event(sk, CA_EVENT_TX_START);
+		if (rtx) {
+			seq = f->rtxq[f->rtxq_head++ % f->rtxq_cap];
+			if (seg_get(f, seq)->flags & SEG_SACKED)
+				continue;
+		} else {
+			seq = f->snd_nxt++;
+			if (app_limited_src(f))
+				f->app_bytes -= MSS;
+		}
+		transmit(f, seq, rtx);
+	}
+}
+
+static void update_rtt(struct flow *f, long rtt_us)
+{
+	struct tcp_sock *tp = &f->tp;
+
+	if (rtt_us <= 0)
+		return;
+	if (!tp->rtt_min_us || rtt_us < tp->rtt_min_us)
+		tp->rtt_min_us = rtt_us;
+	if (!tp->srtt_us) {
+		tp->srtt_us = rtt_us << 3;
+		f->rttvar_us = rtt_us / 2;
+		return;
+	}
+	f->rttvar_us = (3 * f->rttvar_us +
+			labs((long)(tp->srtt_us >> 3) - rtt_us)) / 4;
+	tp->srtt_us = tp->srtt_us - (tp->srtt_us >> 3) + rtt_us;
+}
+
+/* The whole connection is acked: close it, and open the next one after a
+ * handshake. Sequence numbers carry on, so nothing of the old connection
+ * can be mistaken for the new one; the socket starts over.
+ */
+static void flow_close(struct flow *f)
+{
+	if (f->ops->release)
+		f->ops->release(flow_sk(f));
+	sim_ehash_del(flow_sk(f));
+	if (in_window())
+		f->conns++;
+	memset(&f->tp, 0, sizeof(f->tp));
+	f->cwnd_limited_now = false;
+	f->cwnd_window_end = 0;
+	f->active = false;
+	ev_at(now_ns + (u64)f->rtt_us * 1000, EV_START, f - flows);
+}
+
+/* Move the connection to another host as CRIU does: dump the socket in
+ * repair mode, reading the checkpoints out of /proc/net/tcp_bbr3_ckpt while
+ * it is still connected, close it, and restore it in repair mode with the
+ * checkpoints written back and the cwnd of a new one. Closing a socket in
+ * repair mode goes through tcp_disconnect(), which unhashes it and clears
+ * its ports and local address before the congestion control is released;
+ * the dump image keeps the 4-tuple for the restore. There is one netns, so
+ * the text goes back where it came from, replacing the checkpoint it was
+ * read from. Nothing in flight is lost: only the congestion control starts
+ * over. A cold migration leaves repair mode and the checkpoint out.
+ */
+static void flow_migrate(struct flow *f)
+{
+	struct tcp_sock *tp = &f->tp;
+	struct sock *sk = flow_sk(f);
+	__be32 saddr = sk->sk_rcv_saddr;
+	__be16 dport = sk->sk_dport;
+	u16 num = sk->sk_num;
+	char *ckpt = NULL;
+	size_t len = 0;
+	FILE *mem;
+	int err = 0;
+
+	tp->repair = !f->cfg->migrate_cold;
+	if (tp->repair) {
+		mem = open_memstream(&ckpt, &len);
+		if (!mem)
+			abort();
+		err = proc_file_read("tcp_bbr3_ckpt", mem);
+		fclose(mem);
+	}
+
+	/* tcp_disconnect(): tcp_set_state(TCP_CLOSE) unhashes the socket and
+	 * inet_put_port() clears sk_num, then the rest of the tuple goes
+	 */
+	sk->sk_state = TCP_CLOSE;
+	sim_ehash_del(sk);
+	sk->sk_num = 0;
+	sk->sk_dport = 0;
+	sk->sk_rcv_saddr = 0;
+	if (f->ops->release)
+		f->ops->release(sk);
+
+	if (tp->repair) {
+		if (!err)
+			err = proc_file_write("tcp_bbr3_ckpt", ckpt, len);
+		free(ckpt);
+		if (err && err != -ENOENT) {
+			fprintf(stderr, "checkpoint import failed: %s\n",
+				strerror(-err));
+			exit(1);
+		}
+	}
+	sk->sk_rcv_saddr = saddr;
+	sk->sk_num = num;
+	sk->sk_dport = dport;
+	sk->sk_state = TCP_ESTABLISHED;
+	sim_ehash_add(sk);
+	memset(tp->inet_conn.icsk_ca_priv, 0,
+	       sizeof(tp->inet_conn.icsk_ca_priv));
+	tp->snd_cwnd = TCP_INIT_CWND;
+	tp->snd_ssthresh = TCP_INFINITE_SSTHRESH;
+	f->ops->init(sk);
+	tp->repair = 0;
+	flow_try_send(f);
+}
+
+static void process_ack(struct flow *f, const struct ack_batch *b)
+{
+	struct tcp_sock *tp = &f->tp;
+	struct sock *sk = flow_sk(f);
+	struct rate_sample rs = { .rtt_us = -1, .interval_us = -1 };
+	u32 prior_delivered = tp->delivered, prior_lost = tp->lost;
+	u32 snd_una = f->snd_una;
+	u64 newest_tx = 0, first_tx_us = 0;
+	bool have_prior = false;
+	int i;
+
+	tp->tcp_mstamp = us_now();
+	rs.prior_in_flight = tcp_packets_in_flight(tp);
+
+	for (i = 0; i < b->n; i++) {
+		struct seg *s = seg_get(f, b->seq[i]);
+
+		if (s->flags & SEG_SACKED) {
+			f->spurious++;
+			continue;
+		}
+		/* tcp_rate_skb_delivered(): the newest send wins */
+		if (!have_prior || after(s->delivered, rs.prior_delivered)) {
+			have_prior = true;
+			rs.prior_delivered = s->delivered;
+			rs.prior_mstamp = s->delivered_us;
+			rs.is_app_limited = s->app_limited;
+			rs.is_retrans = s->flags & SEG_RETRANS;
+			rs.snd_interval_us = b->tx_ns[i] / 1000 - s->first_tx_us;
+			first_tx_us = b->tx_ns[i] / 1000;
+		}
+		if (!(s->flags & SEG_LOST))
+			tp->packets_out--;
+		s->flags = (s->flags & ~SEG_LOST) | SEG_SACKED;
+		tp->delivered++;
+		if (b->ce[i])
+			tp->delivered_ce++;
+		if (in_window())
+			f->bytes_acked += MSS;
+		if (b->tx_ns[i] > newest_tx && !(s->flags & SEG_RETRANS))
+			newest_tx = b->tx_ns[i];
+		f->rack_tx_ns = max(f->rack_tx_ns, b->tx_ns[i]);
+	}
+	if (first_tx_us)
+		f->first_tx_us = first_tx_us;
+	while (f->snd_una < f->snd_nxt &&
+	       (seg_get(f, f->snd_una)->flags & SEG_SACKED))
+		f->snd_una++;
+
+	if (newest_tx) {
+		rs.rtt_us = (now_ns - newest_tx) / 1000;
+		update_rtt(f, rs.rtt_us);
+	}
+
+	/* RACK: anything sent before a delivered packet and still
+	 * outstanding was dropped, since the path never reorders.
+	 */
+	while (f->txq_head != f->txq_tail) {
+		struct txq_ent *e = &f->txq[f->txq_head % f->txq_cap];
+		struct seg *s = seg_get(f, e->seq);
+
+		if (s->tx_ns != e->tx_ns || (s->flags & (SEG_SACKED | SEG_LOST))) {
+			f->txq_head++;
+			continue;
+		}
+		if (e->tx_ns >= f->rack_tx_ns)
+			break;
+		mark_lost(f, e->seq);
+		f->txq_head++;
+	}
+
+	/* tcp_fastretrans_alert(), reduced to state changes */
+	if (tp->lost != prior_lost &&
+	    tp->inet_conn.icsk_ca_state < TCP_CA_Recovery) {
+		tp->snd_ssthresh = f->ops->ssthresh(sk);
+		if (!f->ops->cong_control)
+			tp->snd_cwnd = max(tp->snd_ssthresh, 2U);
+		f->high_seq = f->snd_nxt;
+		set_ca_state(f, TCP_CA_Recovery);
+	} else if (tp->inet_conn.icsk_ca_state >= TCP_CA_Recovery &&
+		   !before(f->snd_una, f->high_seq)) {
+		set_ca_state(f, TCP_CA_Open);
+	}
+
+	if (tp->delivered == prior_delivered && f->snd_una == snd_una)
+		return;
+
+	/* tcp_rate_gen() */
+	if (tp->app_limited && after(tp->delivered, tp->app_limited))
+		tp->app_limited = 0;
+	if (have_prior) {
+		tp->delivered_mstamp = us_now();
+		rs.delivered = tp->delivered - rs.prior_delivered;
+		rs.rcv_interval_us = us_now() - rs.prior_mstamp;
+		rs.interval_us = max(rs.snd_interval_us, rs.rcv_interval_us);
+		if (rs.interval_us < (long)tcp_min_rtt(tp)) {
+			rs.interval_us = -1;
+			rs.is_app_limited = false;
+		}
+	}
+	rs.acked_sacked = tp->delivered - prior_delivered;
+	rs.losses = tp->lost - prior_lost;
+
+	if (f->ops->pkts_acked) {
+		struct ack_sample sample = {
+			.pkts_acked = rs.acked_sacked,
+			.rtt_us = rs.rtt_us,
+			.in_flight = rs.prior_in_flight,
+		};
+
+		f->ops->pkts_acked(sk, &sample);
+	}
+
+	/* tcp_cwnd_validate(), once per window of data */
+	if (!before(tp->delivered, f->cwnd_window_end)) {
+		tp->is_cwnd_limited = f->cwnd_limited_now;
+		f->cwnd_limited_now = false;
+		f->cwnd_window_end = tp->delivered + tcp_packets_in_flight(tp);
+	}
+
+	if (ack_trace) {
+		struct ack_rec r;
+
+		ack_rec_capture(&r, sk, &rs, f->cookie);
+		ack_rec_write(ack_trace, &r);
+	}
+	if (f->ops->cong_control)
+		f->ops->cong_control(sk, &rs);
+	else if (tp->inet_conn.icsk_ca_state != TCP_CA_Recovery)
+		f->ops->cong_avoid(sk, f->snd_una, rs.acked_sacked);
+	tp->snd_cwnd = max(tp->snd_cwnd, 1U);
+
+	if (tp->packets_out)
+		arm_rto(f);
+	if (f->cfg->conn_kb && f->snd_una == f->conn_end) {
+		flow_close(f);
+		return;
+	}
+	flow_try_send(f);
+}
+
+static void on_rto(struct flow *f)
+{
+	struct tcp_sock *tp = &f->tp;
+	struct sock *sk = flow_sk(f);
+
+	f->rto_armed = false;
+	if (!tp->packets_out || !f->active)
+		return;
+	if (now_ns < f->rto_deadline_ns) {
+		f->rto_armed = true;
+		ev_at(f->rto_deadline_ns, EV_RTO, f - flows);
+		return;
+	}
+	/* tcp_enter_loss() */
+	f->rtos++;
+	tp->tcp_mstamp = us_now();
+	if (tp->inet_conn.icsk_ca_state < TCP_CA_Recovery)
+		tp->snd_ssthresh = f->ops->ssthresh(sk);
+	while (f->txq_head != f->txq_tail) {
+		struct txq_ent *e = &f->txq[f->txq_head++ % f->txq_cap];
+
+		if (seg_get(f, e->seq)->tx_ns == e->tx_ns)
+			mark_lost(f, e->seq);
+	}
+	tp->snd_cwnd = tcp_packets_in_flight(tp) + 1;
+	f->high_seq = f->snd_nxt;
+	set_ca_state(f, TCP_CA_Loss);
+	if (f->ops->cwnd_event)
+		f->ops->cwnd_event(sk, CA_EVENT_LOSS);
+	arm_rto(f);
+	flow_try_send(f);
+}
+
+static void flow_start(struct flow *f)
+{
+	struct tcp_sock *tp = &f->tp;
+	struct sock *sk = flow_sk(f);
+
+	sk->sk_state = TCP_ESTABLISHED;
+	sk->sk_family = AF_INET;
+	/* 10.0.0.1:<32768 + flow> to 10.0.1.<flow + 1>:443, so one
+	 * destination per flow
+	 */
+	sk->sk_rcv_saddr = htonl(0x0a000001);
+	sk->sk_daddr = htonl(0x0a000101 + (f - flows));
+	sk->sk_num = 32768 + (f - flows);
+	sk->sk_dport = htons(443);
+	sk->sk_max_pacing_rate = ~0UL;
+	sk->sk_pacing_shift = 10;
+	sk->sk_gso_max_size = GSO_MAX_SIZE;
+	sk->sk_sndbuf = 4 * 1024 * 1024;
+	tp->mss_cache = MSS;
+	tp->snd_cwnd = TCP_INIT_CWND;
+	tp->snd_cwnd_clamp = ~0U;
+	tp->snd_ssthresh = TCP_INFINITE_SSTHRESH;
+	tp->tcp_mstamp = us_now();
+	tp->delivered = 1;	/* the SYN */
+	/* the handshake has produced one RTT sample already */
+	update_rtt(f, f->rtt_us);
+	tp->inet_conn.icsk_ca_ops = f->ops;
+	f->cookie = ++next_cookie;
+	sk->sk_cookie = f->cookie;
+	sim_ehash_add(sk);
+	f->app_stamp_ns = now_ns;
+	if (f->cfg->conn_kb)
+		f->conn_end = f->snd_nxt +
+			      (f->cfg->conn_kb * 1024 + MSS - 1) / MSS;
+	f->active = true;
+	f->ops->init(sk);
+	flow_try_send(f);
+}
+
+/* ---------------- driver ---------------- */
+
+static void trace_flows(void)
+{
+	int i;
+
+	for (i = 0; i < nflows; i++) {
+		struct flow *f = &flows[i];
+		struct sock *sk = flow_sk(f);
+		union tcp_cc_info info = {};
+		int attr = 0;
+
+		if (!f->active)
+			continue;
+		printf("%8.3f flow %d cwnd %u inflight %u pacing %.2fMbps "
+		       "srtt %uus ca %u", now_ns / 1e9, i, f->tp.snd_cwnd,
+		       tcp_packets_in_flight(&f->tp),
+		       sk->sk_pacing_rate * 8 / 1e6, f->tp.srtt_us >> 3,
+		       f->tp.inet_conn.icsk_ca_state);
+		if (f->ops->get_info &&
+		    f->ops->get_info(sk, ~0U, &attr, &info) &&
+		    attr == INET_DIAG_BBRINFO)
+			printf(" bw_lo %u bw_hi %u min_rtt %u pacing_gain %u "
+			       "cwnd_gain %u", info.bbr.bbr_bw_lo,
+			       info.bbr.bbr_bw_hi, info.bbr.bbr_min_rtt,
+			       info.bbr.bbr_pacing_gain,
+			       info.bbr.bbr_cwnd_gain);
+		printf("\n");
+	}
+}
+
+static double pct(u64 n, u64 d)
+{
+	return d ? 100.0 * n / d : 0;
+}
+
+static double delay_quantile(double q)
+{
+	u64 want = link.delay_samples * q, seen = 0;
+	u32 i;
+
+	for (i = 0; i < DELAY_BINS; i++) {
+		seen += link.delay_hist[i];
+		if (seen > want)
+			return (i + 0.5) * DELAY_BIN_US / 1000.0;
+	}
+	return 0;
+}
+
+static void run(const struct scenario *s, const char *cc)
+{
+	u64 end_ns = s->duration_s * NSEC_PER_SEC, sent = 0, rtx = 0;
+	double bdp = s->mbps * 1e6 / 8 * s->rtt_us / 1e6;
+	double tput[MAX_FLOWS], sum = 0, sumsq = 0, own = 0, window_s;
+	int i, nown = 0;
+
+	sc = s;
+	rng_state = rng_seed;	/* results do not depend on scenario order */
+	netns_reset();
+	memset(&link, 0, sizeof(link));
+	memset(flows, 0, sizeof(flows));
+	heap_len = 0;
+	now_ns = 0;
+	jiffies = 0;
+	link.rate_bps = s->mbps * 1e6;
+	link.buf_bytes = max(s->buf_bdp * bdp, 4.0 * PKT_BYTES);
+	link.ecn_k_bytes = s->ecn_k_bdp * bdp;
+	link.policer_bps = s->policer_mbps * 1e6;
+	link.policer_depth = link.tokens = 64 * 1024;
+	link.delay_hist = calloc(DELAY_BINS, sizeof(*link.delay_hist));
+	if (!link.delay_hist)
+		abort();
+
+	nflows = s->nflows;
+	for (i = 0; i < nflows; i++) {
+		struct flow *f = &flows[i];
+		const char *name = s->flows[i].cc ? s->flows[i].cc : cc;
+
+		f->cfg = &s->flows[i];
+		f->rtt_us = f->cfg->rtt_us;
+		f->ops = ca_find(name);
+		if (!f->ops) {
+			fprintf(stderr, "unknown congestion control %s\n", name);
+			exit(1);
+		}
+		f->ecn = f->cfg->ecn || (f->ops->flags & TCP_CONG_NEEDS_ECN);
+		ev_at(f->cfg->start_s * NSEC_PER_SEC, EV_START, i);
+		if (f->cfg->stop_s)
+			ev_at(f->cfg->stop_s * NSEC_PER_SEC, EV_STOP, i);
+		if (f->cfg->migrate_s)
+			ev_at(f->cfg->migrate_s * NSEC_PER_SEC, EV_MIGRATE, i);
+	}
+	if (s->step_s)
+		ev_at(s->step_s * NSEC_PER_SEC, EV_RATE, 0);
+	if (s->rtt_step_s)
+		ev_at(s->rtt_step_s * NSEC_PER_SEC, EV_RTT, 0);
+	if (trace_ns)
+		ev_at(trace_ns, EV_TRACE, 0);
+
+	while (heap_len && heap[0].t <= end_ns) {
+		struct event e = ev_pop();
+		struct flow *f = &flows[e.flow];
+
+		now_ns = e.t;
+		jiffies = now_ns / (NSEC_PER_SEC / HZ);
+		switch (e.type) {
+		case EV_LINK_DONE:
+			link_done();
+			break;
+		case EV_RX:
+			rx_packet(f, e.seq, e.tx_ns, e.ce);
+			break;
+		case EV_ACK:
+			if (f->active)
+				process_ack(f, e.ack);
+			free(e.ack);
+			break;
+		case EV_SEND:
+			if (e.t != f->send_ev_ns)
+				break;
+			f->send_ev_ns = 0;
+			flow_try_send(f);
+			break;
+		case EV_RTO:
+			on_rto(f);
+			break;
+		case EV_DELACK:
+			f->delack_armed = false;
+			rx_send_ack(f);
+			break;
+		case EV_RATE:
+			link_account();
+			link.rate_bps = s->step_mbps * 1e6;
+			break;
+		case EV_RTT:
+			for (i = 0; i < nflows; i++)
+				flows[i].rtt_us = s->rtt_step_us;
+			break;
+		case EV_START:
+			if (f->cfg->stop_s &&
+			    now_ns >= f->cfg->stop_s * NSEC_PER_SEC)
+				break;
+			flow_start(f);
+			break;
+		case EV_STOP:
+			f->active = false;
+			break;
+		case EV_MIGRATE:
+			if (f->active)
+				flow_migrate(f);
+			break;
+		case EV_TRACE:
+			trace_flows();
+			ev_at(now_ns + trace_ns, EV_TRACE, 0);
+			break;
+		}
+	}
+	now_ns = end_ns;
+	link_account();
+	while (heap_len) {
+		struct event e = ev_pop();
+
+		free(e.ack);
+	}
+
+	window_s = s->duration_s - s->warmup_s;
+	for (i = 0; i < nflows; i++) {
+		tput[i] = flows[i].bytes_acked * 8 / window_s / 1e6;
+		sum += tput[i];
+		sumsq += tput[i] * tput[i];
+		if (!flows[i].cfg->cc) {
+			own += tput[i];
+			nown++;
+		}
+		sent += flows[i].sent;
+		rtx += flows[i].retrans;
+	}
+
+	/* utilization counts wire bytes; the per-flow rates are goodput */
+	printf("%-10s %-8s util %5.1f%%  p50 %7.2fms  p99 %7.2fms  "
+	       "loss %5.2f%%  rtx %5.2f%%  jain %.3f  share ",
+	       s->name, cc, link.cap_bytes ?
+	       100.0 * sum * 1e6 / 8 * window_s * PKT_BYTES / MSS /
+	       link.cap_bytes : 0.0,
+	       delay_quantile(0.5), delay_quantile(0.99),
+	       pct(link.drops, link.arrivals), pct(rtx, sent),
+	       sumsq ? sum * sum / (nflows * sumsq) : 0.0);
+	/* Throughput of the cc under test over its fair share, with others */
+	if (nown < nflows)
+		printf("%4.2f", sum ? own * nflows / (nown * sum) : 0.0);
+	else
+		printf("   -");
+	printf("  Mbps");
+	for (i = 0; i < nflows; i++)
+		printf(" %.1f", tput[i]);
+	printf("\n");
+	if (verbose)
+		for (i = 0; i < nflows; i++)
+			printf("  flow %d: %s sent %llu rtx %llu spurious %llu "
+			       "rtos %llu conns %llu cwnd %u pacing %.1fMbps\n",
+			       i, flows[i].ops->name,
+			       (unsigned long long)flows[i].sent,
+			       (unsigned long long)flows[i].retrans,
+			       (unsigned long long)flows[i].spurious,
+			       (unsigned long long)flows[i].rtos,
+			       (unsigned long long)flows[i].conns,
+			       flows[i].tp.snd_cwnd,
+			       flows[i].tp.inet_conn.icsk_inet.sk_pacing_rate *
+			       8 / 1e6);
+
+	for (i = 0; i < nflows; i++) {
+		free(flows[i].segs);
+		free(flows[i].txq);
+		free(flows[i].rtxq);
+		free(flows[i].pending);
+	}
+	free(link.q);
+	free(link.delay_hist);
+}
+
+static void usage(const char *prog)
+{
+	unsigned int i;
+
+	fprintf(stderr,
+		"usage: %s [-c cc] [-p param=value]... [-S seed] [-t ms] [-s] [-v] "
+		"[-w trace] [scenario|all]...\n\nscenarios:\n", prog);
+	for (i = 0; i < ARRAY_SIZE(scenarios); i++)
+		fprintf(stderr, "  %-10s %s\n", scenarios[i].name,
+			scenarios[i].desc);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	const char *cc = default_cc;
+	unsigned int i;
+	int opt, err;
+
+	while ((opt = getopt(argc, argv, "c:p:S:t:svw:h")) != -1) {
+		switch (opt) {
+		case 'c':
+			cc = optarg;
+			break;
+		case 'p':
+			err = set_param(optarg);
+			if (err) {
+				fprintf(stderr, "bad parameter %s: %s\n",
+					optarg, strerror(-err));
+				return 2;
+			}
+			break;
+		case 'S':
+			rng_seed = rng_seed_from(strtoull(optarg, NULL, 0));
+			break;
+		case 't':
+			trace_ns = strtoul(optarg, NULL, 0) * 1000000ULL;
+			break;
+		case 's':
+			dump_proc = true;
+			break;
+		case 'v':
+			verbose++;
+			break;
+		case 'w':
+			ack_trace = fopen(optarg, "w");
+			if (!ack_trace) {
+				fprintf(stderr, "%s: %s\n", optarg, strerror(errno));
+				return 2;
+			}
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	tcp_register_congestion_control(&sim_reno);
+	err = sim_module_init();
+	if (err) {
+		fprintf(stderr, "module init failed: %d\n", err);
+		return 1;
+	}
+
+	if (optind == argc) {
+		for (i = 0; i < ARRAY_SIZE(scenarios); i++)
+			run(&scenarios[i], cc);
+		goto out;
+	}
+	for (; optind < argc; optind++) {
+		bool found = false;
+
+		for (i = 0; i < ARRAY_SIZE(scenarios); i++) {
+			if (!strcmp(argv[optind], "all") ||
+			    !strcmp(argv[optind], scenarios[i].name)) {
+				run(&scenarios[i], cc);
+				found = true;
+			}
+		}
+		if (!found)
+			usage(argv[0]);
+	}
+out:
+	if (dump_proc)
+		print_proc_files();
+	if (ack_trace)
+		fclose(ack_trace);
+	return 0;
+}
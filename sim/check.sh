@@ -0,0 +1,45 @@
+#!/bin/sh
+
+# Simulator regression checks
+# Each check runs one scenario and bounds one of the results it prints.
+# Results only depend on the seed, so a failure is a change in behaviour,
+# never noise. Bounds leave room for changes elsewhere in the model.
+#
+# Usage: check.sh [path to bbr3_sim]
+
+SIM=${1:-./bbr3_sim}
+failed=0
+
+# expect <metric> <min|max> <bound> <bbr3_sim arguments>...
+expect() {
+    metric=$1 dir=$2 bound=$3
+    shift 3
+    value=$("$SIM" "$@" | awk -v m="$metric" '
+        { for (i = 1; i < NF; i++) if ($i == m) { v = $(i + 1); exit } }
+        END { sub(/%|ms$/, "", v); print v }')
+    if [ -n "$value" ] && awk -v v="$value" -v b="$bound" -v d="$dir" \
+        'BEGIN { exit !(d == "min" ? v + 0 >= b : v + 0 <= b) }'; then
+        echo "ok   $*: $metric $value ($dir $bound)"
+    else
+        echo "FAIL $*: $metric ${value:-?} ($dir $bound)"
+        failed=1
+    fi
+}
+
+# 1% random loss: a loss cut of bw_lo stops at the round's max bw sample,
+# not at the rate of the ACK that ends the round
+expect util min 45 -c bbr3_v2 lossy
+expect util min 45 -c bbr3_v3 lossy
+
+# Without drain_to_target, PROBE_DOWN still lasts a round rather than
+# ending on its first ACK, so the queue of the last probe drains
+expect p99 max 6.5 -c bbr3_v2 -p drain_to_target=0 single
+expect p99 max 6.5 -c bbr3_v3 -p drain_to_target=0 single
+
+# A migration resumes from the checkpoint read while the socket is dumped,
+# not from STARTUP as migrate_cold does (p99 39.80ms)
+expect p99 max 20 -c bbr3_v1 migrate
+expect p99 max 20 -c bbr3_v2 migrate
+expect p99 max 20 -c bbr3_v3 migrate
+
+exit $failed
@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/* perf_event_open(2) counters for bbr3_replay */
+
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "counters.h"
+
+const char * const counter_names[CNT_MAX] = {
+	"cycles", "insns", "cache-miss", "br-miss",
+};
+
+static const unsigned long long counter_config[CNT_MAX] = {
+	[CNT_CYCLES]		= PERF_COUNT_HW_CPU_CYCLES,
+	[CNT_INSNS]		= PERF_COUNT_HW_INSTRUCTIONS,
+	[CNT_CACHE_MISSES]	= PERF_COUNT_HW_CACHE_MISSES,
+	[CNT_BRANCH_MISSES]	= PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+static int counter_fd[CNT_MAX] = { -1, -1, -1, -1 };
+
+void counters_open(void)
+{
+	int i;
+
+	for (i = 0; i < CNT_MAX; i++) {
+		struct perf_event_attr attr = {
+			.type		= PERF_TYPE_HARDWARE,
+			.size		= sizeof(attr),
+			.config		= counter_config[i],
+			.disabled	= 1,
+			.exclude_kernel	= 1,
+			.exclude_hv	= 1,
+		};
+
+		counter_fd[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+	}
+}
+
+static void counters_ioctl(unsigned long req)
+{
+	int i;
+
+	for (i = 0; i < CNT_MAX; i++)
+		if (counter_fd[i] >= 0)
+			ioctl(counter_fd[i], req, 0);
+}
+
+void counters_reset(void)
+{
+	counters_ioctl(PERF_EVENT_IOC_RESET);
+}
+
+void counters_enable(bool on)
+{
+	counters_ioctl(on ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE);
+}
+
+bool counter_read(int cnt, unsigned long long *val)
+{
+	return counter_fd[cnt] >= 0 &&
+	       read(counter_fd[cnt], val, sizeof(*val)) == sizeof(*val);
+}
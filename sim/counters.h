@@ -0,0 +1,21 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/* Hardware event counters for bbr3_replay, kept apart from the kernel shims
+ * since <linux/perf_event.h> brings the host's own kernel types.
+ */
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <stdbool.h>
+
+enum { CNT_CYCLES, CNT_INSNS, CNT_CACHE_MISSES, CNT_BRANCH_MISSES, CNT_MAX };
+
+extern const char * const counter_names[CNT_MAX];
+
+/* User space only, this thread; counters the host won't give stay off */
+void counters_open(void);
+void counters_reset(void);
+void counters_enable(bool on);
+/* false if the counter is unavailable */
+bool counter_read(int cnt, unsigned long long *val);
+
+#endif /* COUNTERS_H */
@@ -0,0 +1,12 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/* Tracepoints compile to nothing in the simulator */
+#include "../sim_kernel.h"
+
+#ifndef SIM_TRACEPOINT_H
+#define SIM_TRACEPOINT_H
+#define TP_PROTO(args...)	args
+#define TP_ARGS(args...)	args
+#define TRACE_EVENT(name, proto, args, tstruct, assign, print) \
+	static inline void trace_##name(proto) {}		\
+	static inline bool trace_##name##_enabled(void) { return false; }
+#endif
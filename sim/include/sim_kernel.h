@@ -0,0 +1,368 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/* Userspace stand-ins for the kernel APIs tcp_bbr3.c uses.
+ *
+ * Only what the congestion control module touches is modeled: the tcp_sock
+ * fields it reads and writes, rate_sample, the congestion control ops, and
+ * the handful of helpers and macros around them. Every linux/ and net/
+ * header in this directory just pulls this file in.
+ */
+#ifndef _SIM_KERNEL_H
+#define _SIM_KERNEL_H
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef unsigned long long u64;	/* as in the kernel, for %llu */
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef long long s64;
+typedef u8 __u8;
+typedef u16 __u16;
+typedef u32 __u32;
+typedef u64 __u64;
+typedef u16 __be16;
+typedef u32 __be32;
+
+#define __read_mostly
+#define __init
+#ifndef __always_inline
+#define __always_inline	inline __attribute__((__always_inline__))
+#endif
+#define __exit
+#define likely(x)	__builtin_expect(!!(x), 1)
+#define unlikely(x)	__builtin_expect(!!(x), 0)
+
+#define min(a, b)	((a) < (b) ? (a) : (b))
+#define max(a, b)	((a) > (b) ? (a) : (b))
+#define min3(a, b, c)	min(min(a, b), c)
+#define min_t(t, a, b)	((t)(a) < (t)(b) ? (t)(a) : (t)(b))
+#define max_t(t, a, b)	((t)(a) > (t)(b) ? (t)(a) : (t)(b))
+#define clamp(v, l, h)	min(max(v, l), h)
+#define clamp_t(t, v, l, h) min_t(t, max_t(t, v, l), h)
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+#define BUILD_BUG_ON(c)	_Static_assert(!(c), #c)
+#define READ_ONCE(x)	(*(volatile __typeof__(x) *)&(x))
+#define WRITE_ONCE(x, v) (*(volatile __typeof__(x) *)&(x) = (v))
+#define cmpxchg(p, o, n) ({					\
+	__typeof__(*(p)) __old = *(p);				\
+	if (__old == (o))					\
+		*(p) = (n);					\
+	__old; })
+
+/* 64-bit divisions are counted: they are library calls on 32-bit hosts */
+extern unsigned long sim_div64s;
+
+#define do_div(n, base) ({					\
+	u32 __base = (base);					\
+	u32 __rem = (u64)(n) % __base;				\
+	(n) = (u64)(n) / __base;				\
+	sim_div64s++;						\
+	__rem; })
+#define U16_MAX		((u16)~0U)
+#define U32_MAX		((u32)~0U)
+#define U64_MAX		((u64)~0ULL)
+
+static inline u64 div_u64(u64 a, u32 b) { sim_div64s++; return a / b; }
+static inline u64 mul_u64_u32_shr(u64 a, u32 mul, unsigned int shift)
+{
+	return (u64)(((unsigned __int128)a * mul) >> shift);
+}
+static inline u64 div64_u64(u64 a, u64 b) { sim_div64s++; return a / b; }
+static inline s64 div64_long(s64 a, long b) { sim_div64s++; return a / b; }
+static inline u32 reciprocal_scale(u32 val, u32 ep_ro)
+{
+	return (u32)(((u64)val * ep_ro) >> 32);
+}
+static inline int ilog2(u64 v) { return v ? 63 - __builtin_clzll(v) : -1; }
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define htonl(x)	__builtin_bswap32(x)
+#define htons(x)	__builtin_bswap16(x)
+#else
+#define htonl(x)	((u32)(x))
+#define htons(x)	((u16)(x))
+#endif
+#define ntohl(x)	htonl(x)
+#define ntohs(x)	htons(x)
+
+#define USEC_PER_SEC	1000000UL
+#define USEC_PER_MSEC	1000UL
+#define MSEC_PER_SEC	1000UL
+#define NSEC_PER_USEC	1000UL
+#define NSEC_PER_MSEC	1000000UL
+
+#define pr_info(fmt, ...)	sim_log(fmt, ##__VA_ARGS__)
+#define pr_warn(fmt, ...)	sim_log(fmt, ##__VA_ARGS__)
+#define pr_err(fmt, ...)	sim_log(fmt, ##__VA_ARGS__)
+void sim_log(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/* Modules: parameters register themselves so the simulator can set them
+ * (-p name=value), and init/exit are reachable by name.
+ */
+void sim_register_param(const char *name, void *addr, size_t size);
+#define module_param(name, type, perm)					\
+	static void __attribute__((constructor)) sim_param_##name(void)	\
+	{								\
+		sim_register_param(#name, &name, sizeof(name));		\
+	}
+#define MODULE_PARM_DESC(name, desc)
+#define module_init(fn)	int sim_module_init(void) { return fn(); }
+#define module_exit(fn)	void sim_module_exit(void) { fn(); }
+#define MODULE_AUTHOR(x)
+#define MODULE_LICENSE(x)
+#define MODULE_VERSION(x)
+#define MODULE_DESCRIPTION(x)
+#define THIS_MODULE	NULL
+
+/* Time: the simulator advances these clocks */
+#define HZ		1000
+extern unsigned long jiffies;
+#define tcp_jiffies32	((u32)jiffies)
+#define after(a, b)	((s32)((b) - (a)) < 0)
+#define before(a, b)	after(b, a)
+static inline unsigned long msecs_to_jiffies(unsigned int m) { return m; }
+static inline unsigned int jiffies_to_msecs(unsigned long j) { return j; }
+static inline unsigned int jiffies_to_usecs(unsigned long j) { return j * 1000; }
+static inline unsigned long usecs_to_jiffies(unsigned int u) { return u / 1000; }
+
+u32 get_random_u32(void);
+
+#ifndef offsetofend
+#define offsetofend(TYPE, MEMBER) \
+	(offsetof(TYPE, MEMBER) + sizeof(((TYPE *)0)->MEMBER))
+#endif
+
+static inline int fls64(u64 x) { return x ? 64 - __builtin_clzll(x) : 0; }
+
+/* Per-CPU data: the simulator runs on one CPU */
+#define DEFINE_PER_CPU(type, name)	type name
+#define this_cpu_inc(var)		((var)++)
+#define per_cpu_ptr(ptr, cpu)		(ptr)
+#define for_each_possible_cpu(cpu)	for ((cpu) = 0; (cpu) < 1; (cpu)++)
+
+/* procfs: files are kept in a table the simulator can dump (-s) */
+struct seq_file {
+	FILE *f;
+};
+#define seq_printf(seq, fmt, ...)	fprintf((seq)->f, fmt, ##__VA_ARGS__)
+#define seq_puts(seq, s)		fputs(s, (seq)->f)
+
+struct file {
+	void *private_data;	/* the struct seq_file */
+};
+typedef int (*proc_write_t)(struct file *, char *, size_t);
+struct proc_dir_entry;
+struct proc_dir_entry *proc_create_single(const char *name, int mode,
+					  struct proc_dir_entry *parent,
+					  int (*show)(struct seq_file *, void *));
+struct proc_dir_entry *proc_create_net_single_write(const char *name, int mode,
+		struct proc_dir_entry *parent,
+		int (*show)(struct seq_file *, void *), proc_write_t write,
+		void *data);
+void remove_proc_entry(const char *name, struct proc_dir_entry *parent);
+
+#define SEQ_START_TOKEN			((void *)1)
+struct seq_operations {
+	void *(*start)(struct seq_file *seq, loff_t *pos);
+	void (*stop)(struct seq_file *seq, void *v);
+	void *(*next)(struct seq_file *seq, void *v, loff_t *pos);
+	int (*show)(struct seq_file *seq, void *v);
+};
+struct seq_net_private {
+	struct net *net;
+};
+struct proc_dir_entry *proc_create_net(const char *name, int mode,
+				       struct proc_dir_entry *parent,
+				       const struct seq_operations *ops,
+				       unsigned int state_size);
+
+struct inet_hashinfo;
+struct net {
+	struct proc_dir_entry *proc_net;
+	void *gen[4];		/* net_generic() storage by pernet id */
+	struct {
+		struct {
+			struct inet_hashinfo *hashinfo;
+		} tcp_death_row;
+	} ipv4;
+};
+extern struct net init_net;
+#define seq_file_single_net(seq)	(&init_net)
+#define seq_file_net(seq)		(&init_net)
+#define net_eq(a, b)			((a) == (b))
+
+/* Network namespaces: the simulator has only init_net */
+#define __net_init
+#define __net_exit
+struct pernet_operations {
+	int (*init)(struct net *net);
+	void (*exit)(struct net *net);
+	unsigned int *id;
+	size_t size;
+};
+int register_pernet_subsys(struct pernet_operations *ops);
+void unregister_pernet_subsys(struct pernet_operations *ops);
+static inline void *net_generic(const struct net *net, unsigned int id)
+{
+	return net->gen[id];
+}
+
+/* sysctl: tables are accepted and ignored; -p sets the module defaults */
+#define LINUX_VERSION_CODE		KERNEL_VERSION(6, 8, 0)
+#define KERNEL_VERSION(a, b, c)		(((a) << 16) + ((b) << 8) + (c))
+struct ctl_table {
+	const char *procname;
+	void *data;
+	int maxlen;
+	unsigned short mode;
+	int (*proc_handler)(const struct ctl_table *table, int write,
+			    void *buffer, size_t *lenp, long long *ppos);
+	void *extra1;
+	void *extra2;
+};
+struct ctl_table_header;
+extern int sim_sysctl_vals[3];
+#define SYSCTL_ZERO	((void *)&sim_sysctl_vals[0])
+#define SYSCTL_ONE	((void *)&sim_sysctl_vals[1])
+int proc_dointvec_minmax(const struct ctl_table *table, int write,
+			 void *buffer, size_t *lenp, long long *ppos);
+struct ctl_table_header *register_net_sysctl_sz(struct net *net,
+						const char *path,
+						struct ctl_table *table,
+						size_t table_size);
+void unregister_net_sysctl_table(struct ctl_table_header *header);
+
+#define GFP_KERNEL	0
+static inline void *kmemdup(const void *src, size_t len, int gfp)
+{
+	void *p = malloc(len);
+
+	return p ? memcpy(p, src, len) : NULL;
+}
+static inline void kfree(const void *p) { free((void *)p); }
+#define GFP_ATOMIC	0
+static inline void *kmalloc(size_t len, int gfp) { return malloc(len); }
+
+/* No kernel config: only what the simulator provides is built */
+#define IS_ENABLED(option)	0
+
+/* RCU and locks: the simulator is single threaded, so readers never race a
+ * writer and freed entries can go at once.
+ */
+#define __rcu
+struct rcu_head { void *next; };
+#define rcu_read_lock()			do { } while (0)
+#define rcu_read_unlock()		do { } while (0)
+#define rcu_dereference(p)		(p)
+#define rcu_dereference_protected(p, c)	(p)
+#define rcu_assign_pointer(p, v)	((p) = (v))
+#define RCU_INIT_POINTER(p, v)		((p) = (v))
+#define kfree_rcu(p, field)		kfree(p)
+#define lockdep_is_held(l)		1
+
+typedef struct { int locked; } spinlock_t;
+#define DEFINE_SPINLOCK(l)	spinlock_t l
+#define spin_lock_init(l)	((l)->locked = 0)
+#define spin_lock_bh(l)		((l)->locked = 1)
+#define spin_unlock_bh(l)	((l)->locked = 0)
+
+/* Hash lists, as in <linux/list.h> */
+struct hlist_node {
+	struct hlist_node *next, **pprev;
+};
+struct hlist_head {
+	struct hlist_node *first;
+};
+static inline void hlist_add_head(struct hlist_node *n, struct hlist_head *h)
+{
+	n->next = h->first;
+	if (h->first)
+		h->first->pprev = &n->next;
+	h->first = n;
+	n->pprev = &h->first;
+}
+static inline void hlist_del(struct hlist_node *n)
+{
+	*n->pprev = n->next;
+	if (n->next)
+		n->next->pprev = n->pprev;
+}
+#define hlist_entry_safe(ptr, type, member) \
+	((ptr) ? (type *)((char *)(ptr) - offsetof(type, member)) : NULL)
+#define hlist_for_each_entry(pos, head, member)				\
+	for (pos = hlist_entry_safe((head)->first, __typeof__(*pos), member); \
+	     pos;							\
+	     pos = hlist_entry_safe(pos->member.next, __typeof__(*pos), member))
+#define hlist_for_each_entry_safe(pos, n, head, member)			\
+	for (pos = hlist_entry_safe((head)->first, __typeof__(*pos), member); \
+	     pos && ({ n = pos->member.next; 1; });			\
+	     pos = hlist_entry_safe(n, __typeof__(*pos), member))
+
+/* jhash_3words() and jhash2() as in <linux/jhash.h> */
+#define JHASH_INITVAL		0xdeadbeef
+static inline u32 rol32(u32 w, unsigned int s)
+{
+	return (w << s) | (w >> ((-s) & 31));
+}
+#define __jhash_final(a, b, c)			\
+{						\
+	c ^= b; c -= rol32(b, 14);		\
+	a ^= c; a -= rol32(c, 11);		\
+	b ^= a; b -= rol32(a, 25);		\
+	c ^= b; c -= rol32(b, 16);		\
+	a ^= c; a -= rol32(c, 4);		\
+	b ^= a; b -= rol32(a, 14);		\
+	c ^= b; c -= rol32(b, 24);		\
+}
+static inline u32 jhash_3words(u32 a, u32 b, u32 c, u32 initval)
+{
+	a += JHASH_INITVAL;
+	b += JHASH_INITVAL;
+	c += initval;
+	__jhash_final(a, b, c);
+	return c;
+}
+#define __jhash_mix(a, b, c)			\
+{						\
+	a -= c; a ^= rol32(c, 4);  c += b;	\
+	b -= a; b ^= rol32(a, 6);  a += c;	\
+	c -= b; c ^= rol32(b, 8);  b += a;	\
+	a -= c; a ^= rol32(c, 16); c += b;	\
+	b -= a; b ^= rol32(a, 19); a += c;	\
+	c -= b; c ^= rol32(b, 4);  b += a;	\
+}
+static inline u32 jhash2(const u32 *k, u32 length, u32 initval)
+{
+	u32 a, b, c;
+
+	a = b = c = JHASH_INITVAL + (length << 2) + initval;
+	while (length > 3) {
+		a += k[0];
+		b += k[1];
+		c += k[2];
+		__jhash_mix(a, b, c);
+		length -= 3;
+		k += 3;
+	}
+	switch (length) {
+	case 3: c += k[2];	/* fall through */
+	case 2: b += k[1];	/* fall through */
+	case 1: a += k[0];
+		__jhash_final(a, b, c);
+		break;
+	case 0:
+		break;
+	}
+	return c;
+}
+
+#endif /* _SIM_KERNEL_H */
@@ -0,0 +1,283 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/* Userspace stand-ins for the TCP socket state seen by congestion control */
+#ifndef _SIM_TCP_H
+#define _SIM_TCP_H
+
+#include "sim_kernel.h"
+
+#define ICSK_CA_PRIV_SIZE	104
+#define TCP_INFINITE_SSTHRESH	0x7fffffff
+#define TCP_INIT_CWND		10
+#define GSO_MAX_SIZE		65536
+#define MAX_TCP_HEADER		320
+#define TCP_CA_NAME_MAX		16
+#define AF_INET			2
+#define AF_INET6		10
+
+enum {
+	TCP_CA_Open,
+	TCP_CA_Disorder,
+	TCP_CA_CWR,
+	TCP_CA_Recovery,
+	TCP_CA_Loss,
+};
+
+enum {
+	TCP_ESTABLISHED = 1,
+	TCP_CLOSE = 7,
+};
+
+enum sk_pacing {
+	SK_PACING_NONE = 0,
+	SK_PACING_NEEDED = 1,
+	SK_PACING_FQ = 2,
+};
+
+enum tcp_ca_event {
+	CA_EVENT_TX_START,
+	CA_EVENT_CWND_RESTART,
+	CA_EVENT_COMPLETE_CWR,
+	CA_EVENT_LOSS,
+	CA_EVENT_ECN_NO_CE,
+	CA_EVENT_ECN_IS_CE,
+};
+
+#define TCP_CONG_NON_RESTRICTED	0x1
+#define TCP_CONG_NEEDS_ECN	0x2
+
+#define TCP_ECN_DEMAND_CWR	4
+
+enum tcp_chrono {
+	TCP_CHRONO_UNSPEC,
+	TCP_CHRONO_BUSY,		/* actively sending data */
+	TCP_CHRONO_RWND_LIMITED,	/* stalled by the peer's receive window */
+	TCP_CHRONO_SNDBUF_LIMITED,
+};
+
+enum inet_csk_ack_state_t {
+	ICSK_ACK_SCHED	= 1,
+	ICSK_ACK_TIMER	= 2,
+	ICSK_ACK_PUSHED	= 4,
+	ICSK_ACK_PUSHED2 = 8,
+	ICSK_ACK_NOW	= 16,
+};
+
+/* uapi inet_diag bits */
+#define INET_DIAG_VEGASINFO	3
+#define INET_DIAG_BBRINFO	16
+
+struct tcp_bbr_info {
+	__u32 bbr_bw_lo;
+	__u32 bbr_bw_hi;
+	__u32 bbr_min_rtt;
+	__u32 bbr_pacing_gain;
+	__u32 bbr_cwnd_gain;
+};
+
+union tcp_cc_info {
+	struct tcp_bbr_info bbr;
+#ifdef SIM_CC_INFO_SIZE		/* model kernels with a larger union */
+	char pad[SIM_CC_INFO_SIZE];
+#endif
+};
+
+struct dst_entry {
+	u32 metrics[16];
+};
+
+struct rate_sample {
+	u64 prior_mstamp;
+	u32 prior_delivered;
+	s32 delivered;
+	long interval_us;
+	u32 snd_interval_us;
+	u32 rcv_interval_us;
+	long rtt_us;
+	int losses;
+	u32 acked_sacked;
+	u32 prior_in_flight;
+	bool is_app_limited;
+	bool is_retrans;
+	bool is_ack_delayed;
+};
+
+struct ack_sample {
+	u32 pkts_acked;
+	s32 rtt_us;
+	u32 in_flight;
+};
+
+struct sock;
+
+struct tcp_congestion_ops {
+	u32 (*ssthresh)(struct sock *sk);
+	void (*cong_avoid)(struct sock *sk, u32 ack, u32 acked);
+	void (*set_state)(struct sock *sk, u8 new_state);
+	void (*cwnd_event)(struct sock *sk, enum tcp_ca_event ev);
+	void (*in_ack_event)(struct sock *sk, u32 flags);
+	void (*pkts_acked)(struct sock *sk, const struct ack_sample *sample);
+	u32 (*min_tso_segs)(struct sock *sk);
+	void (*cong_control)(struct sock *sk, const struct rate_sample *rs);
+	u32 (*undo_cwnd)(struct sock *sk);
+	u32 (*sndbuf_expand)(struct sock *sk);
+	size_t (*get_info)(struct sock *sk, u32 ext, int *attr,
+			   union tcp_cc_info *info);
+	char name[TCP_CA_NAME_MAX];
+	void *owner;
+	unsigned long flags;
+	void (*init)(struct sock *sk);
+	void (*release)(struct sock *sk);
+};
+
+/* The chains of the established hash. They end in NULL rather than in a
+ * nulls marker: the simulator has no lockless lookups to restart.
+ */
+struct hlist_nulls_node {
+	struct hlist_nulls_node *next, **pprev;
+};
+struct hlist_nulls_head {
+	struct hlist_nulls_node *first;
+};
+#define hlist_nulls_empty(h)	(!(h)->first)
+
+/* struct sock, inet_connection_sock and tcp_sock are folded into one */
+struct sock {
+	struct hlist_nulls_node sk_nulls_node;	/* in the established hash */
+	u64 sk_cookie;
+	int sk_state;
+	unsigned short sk_family;
+	__be32 sk_daddr;
+	__be32 sk_rcv_saddr;
+	u16 sk_num;		/* local port, host order */
+	__be16 sk_dport;
+	unsigned long sk_pacing_rate;
+	unsigned long sk_max_pacing_rate;
+	int sk_pacing_status;
+	u8 sk_pacing_shift;
+	int sk_sndbuf;
+	int sk_wmem_queued;
+	unsigned int sk_gso_max_size;
+	struct dst_entry *sk_dst;
+};
+
+struct inet_connection_sock {
+	struct sock icsk_inet;
+	const struct tcp_congestion_ops *icsk_ca_ops;
+	u8 icsk_ca_state;
+	struct {
+		u8 pending;
+	} icsk_ack;
+	u64 icsk_ca_priv[ICSK_CA_PRIV_SIZE / sizeof(u64)];
+};
+
+struct tcp_sock {
+	struct inet_connection_sock inet_conn;
+	u32 snd_cwnd;
+	u32 snd_cwnd_clamp;
+	u32 snd_ssthresh;
+	u32 mss_cache;
+	u32 srtt_us;
+	u32 rtt_min_us;
+	u32 delivered;
+	u32 delivered_ce;
+	u32 lost;
+	u32 app_limited;
+	u32 packets_out;
+	u32 sacked_out;
+	u32 lost_out;
+	u32 retrans_out;
+	u32 snd_wnd;
+	u32 rcv_nxt;
+	u8 ecn_flags;
+	u32 lsndtime;
+	u64 tcp_mstamp;
+	u64 delivered_mstamp;
+	u8 is_cwnd_limited;
+	u8 chrono_type;
+	u8 repair;		/* TCP_REPAIR mode */
+};
+
+static inline struct tcp_sock *tcp_sk(const struct sock *sk)
+{
+	return (struct tcp_sock *)sk;
+}
+
+static inline struct inet_connection_sock *inet_csk(const struct sock *sk)
+{
+	return (struct inet_connection_sock *)sk;
+}
+
+static inline void *inet_csk_ca(const struct sock *sk)
+{
+	return (void *)inet_csk(sk)->icsk_ca_priv;
+}
+
+static inline struct net *sock_net(const struct sock *sk)
+{
+	return &init_net;
+}
+
+#define sk_fullsock(sk)		true
+#define sk_nulls_for_each(sk, node, head)				\
+	for (node = (head)->first;					\
+	     node && (sk = (struct sock *)((char *)node -		\
+				offsetof(struct sock, sk_nulls_node)), 1); \
+	     node = node->next)
+
+/* sock_diag_save_cookie(): the simulator numbers connections itself */
+static inline void sock_diag_save_cookie(struct sock *sk, __u32 *cookie)
+{
+	cookie[0] = (u32)sk->sk_cookie;
+	cookie[1] = (u32)(sk->sk_cookie >> 32);
+}
+
+struct inet_ehash_bucket {
+	struct hlist_nulls_head chain;
+};
+struct inet_hashinfo {
+	struct inet_ehash_bucket *ehash;
+	spinlock_t *ehash_locks;
+	unsigned int ehash_mask;
+	unsigned int ehash_locks_mask;
+};
+static inline spinlock_t *inet_ehash_lockp(struct inet_hashinfo *h, u32 hash)
+{
+	return &h->ehash_locks[hash & h->ehash_locks_mask];
+}
+
+static inline u32 net_hash_mix(const struct net *net)
+{
+	return 0;
+}
+
+static inline struct dst_entry *__sk_dst_get(const struct sock *sk)
+{
+	return sk->sk_dst;
+}
+
+static inline u32 tcp_packets_in_flight(const struct tcp_sock *tp)
+{
+	return tp->packets_out - (tp->sacked_out + tp->lost_out) + tp->retrans_out;
+}
+
+static inline u32 tcp_min_rtt(const struct tcp_sock *tp)
+{
+	return tp->rtt_min_us;
+}
+
+static inline s64 tcp_stamp_us_delta(u64 t1, u64 t0)
+{
+	return max_t(s64, t1 - t0, 0);
+}
+
+/* The simulated receivers echo CE per packet by themselves; the module's
+ * receiver side never runs.
+ */
+static inline void __tcp_send_ack(struct sock *sk, u32 rcv_nxt)
+{
+}
+
+int tcp_register_congestion_control(struct tcp_congestion_ops *ops);
+void tcp_unregister_congestion_control(struct tcp_congestion_ops *ops);
+
+#endif /* _SIM_TCP_H */
@@ -0,0 +1 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
@@ -0,0 +1,425 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/* What the simulator and the replay benchmark link tcp_bbr3.c against: the
+ * kernel functions it calls, a registry of congestion controls and module
+ * parameters, a seeded random number generator, and Reno as a baseline.
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdlib.h>
+
+#include "sim_env.h"
+
+/* ---------------- kernel API stand-ins ---------------- */
+
+#define MAX_PROC_FILES	4
+#define MAX_CA		16
+#define MAX_PARAMS	64
+
+#define SIM_EHASH_SIZE	8
+
+unsigned long jiffies;
+unsigned long sim_div64s;
+int verbose;
+
+/* The established hash of init_net. The flows link their sockets in while
+ * connected, with a lock per bucket.
+ */
+static struct inet_ehash_bucket sim_ehash[SIM_EHASH_SIZE];
+static spinlock_t sim_ehash_locks[SIM_EHASH_SIZE];
+static struct inet_hashinfo sim_hashinfo = {
+	.ehash			= sim_ehash,
+	.ehash_locks		= sim_ehash_locks,
+	.ehash_mask		= SIM_EHASH_SIZE - 1,
+	.ehash_locks_mask	= SIM_EHASH_SIZE - 1,
+};
+
+struct net init_net = {
+	.ipv4.tcp_death_row.hashinfo = &sim_hashinfo,
+};
+
+void sim_ehash_add(struct sock *sk)
+{
+	struct hlist_nulls_head *h =
+		&sim_ehash[sk->sk_num & sim_hashinfo.ehash_mask].chain;
+	struct hlist_nulls_node *n = &sk->sk_nulls_node;
+
+	n->next = h->first;
+	if (h->first)
+		h->first->pprev = &n->next;
+	h->first = n;
+	n->pprev = &h->first;
+}
+
+void sim_ehash_del(struct sock *sk)
+{
+	struct hlist_nulls_node *n = &sk->sk_nulls_node;
+
+	if (!n->pprev)
+		return;
+	*n->pprev = n->next;
+	if (n->next)
+		n->next->pprev = n->pprev;
+	n->next = NULL;
+	n->pprev = NULL;
+}
+
+static struct sim_proc_file {
+	const char *name;
+	int (*show)(struct seq_file *, void *);
+	const struct seq_operations *seq_ops;	/* or show */
+	proc_write_t write;
+} proc_files[MAX_PROC_FILES];
+
+struct proc_dir_entry *proc_create_net_single_write(const char *name, int mode,
+		struct proc_dir_entry *parent,
+		int (*show)(struct seq_file *, void *), proc_write_t write,
+		void *data)
+{
+	unsigned int i;
+
+	for (i = 0; i < MAX_PROC_FILES; i++) {
+		if (!proc_files[i].name) {
+			proc_files[i].name = name;
+			proc_files[i].show = show;
+			proc_files[i].seq_ops = NULL;
+			proc_files[i].write = write;
+			return (struct proc_dir_entry *)&proc_files[i];
+		}
+	}
+	return NULL;
+}
+
+struct proc_dir_entry *proc_create_net(const char *name, int mode,
+				       struct proc_dir_entry *parent,
+				       const struct seq_operations *ops,
+				       unsigned int state_size)
+{
+	struct sim_proc_file *p;
+
+	p = (void *)proc_create_net_single_write(name, mode, parent, NULL,
+						 NULL, NULL);
+	if (p)
+		p->seq_ops = ops;
+	return (struct proc_dir_entry *)p;
+}
+
+struct proc_dir_entry *proc_create_single(const char *name, int mode,
+					  struct proc_dir_entry *parent,
+					  int (*show)(struct seq_file *, void *))
+{
+	return proc_create_net_single_write(name, mode, parent, show, NULL,
+					    NULL);
+}
+
+static int proc_file_find(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < MAX_PROC_FILES; i++)
+		if (proc_files[i].name && !strcmp(proc_files[i].name, name))
+			return i;
+	return -ENOENT;
+}
+
+/* seq_read() of the whole file, which the simulator never has to split */
+static int proc_file_show(const struct sim_proc_file *p, struct seq_file *seq)
+{
+	const struct seq_operations *ops = p->seq_ops;
+	loff_t pos = 0;
+	int err = 0;
+	void *v;
+
+	if (!ops)
+		return p->show(seq, NULL);
+	for (v = ops->start(seq, &pos); v && !err; v = ops->next(seq, v, &pos))
+		err = ops->show(seq, v);
+	ops->stop(seq, v);
+	return err;
+}
+
+int proc_file_read(const char *name, FILE *f)
+{
+	struct seq_file seq = { .f = f };
+	int i = proc_file_find(name);
+
+	return i < 0 ? i : proc_file_show(&proc_files[i], &seq);
+}
+
+/* buf is modified, as the kernel's copy of the user buffer may be */
+int proc_file_write(const char *name, char *buf, size_t len)
+{
+	struct seq_file seq = { NULL };
+	struct file file = { .private_data = &seq };
+	int i = proc_file_find(name);
+
+	if (i < 0)
+		return i;
+	if (!proc_files[i].write)
+		return -EIO;
+	return proc_files[i].write(&file, buf, len);
+}
+
+void remove_proc_entry(const char *name, struct proc_dir_entry *parent)
+{
+	unsigned int i;
+
+	for (i = 0; i < MAX_PROC_FILES; i++)
+		if (proc_files[i].name && !strcmp(proc_files[i].name, name))
+			proc_files[i].name = NULL;
+}
+
+int sim_sysctl_vals[3] = { 0, 1, 2 };
+
+int proc_dointvec_minmax(const struct ctl_table *table, int write,
+			 void *buffer, size_t *lenp, long long *ppos)
+{
+	return -EOPNOTSUPP;
+}
+
+struct ctl_table_header *register_net_sysctl_sz(struct net *net,
+						const char *path,
+						struct ctl_table *table,
+						size_t table_size)
+{
+	return (struct ctl_table_header *)table;
+}
+
+void unregister_net_sysctl_table(struct ctl_table_header *header)
+{
+}
+
+static unsigned int pernet_ids;
+static struct pernet_operations *pernet_ops[ARRAY_SIZE(init_net.gen)];
+
+int register_pernet_subsys(struct pernet_operations *ops)
+{
+	int err;
+
+	if (pernet_ids >= ARRAY_SIZE(init_net.gen))
+		return -ENOSPC;
+	pernet_ops[pernet_ids] = ops;
+	*ops->id = pernet_ids++;
+	init_net.gen[*ops->id] = calloc(1, ops->size);
+	if (!init_net.gen[*ops->id])
+		return -ENOMEM;
+	err = ops->init ? ops->init(&init_net) : 0;
+	if (err) {
+		free(init_net.gen[*ops->id]);
+		init_net.gen[*ops->id] = NULL;
+	}
+	return err;
+}
+
+void unregister_pernet_subsys(struct pernet_operations *ops)
+{
+	if (ops->exit)
+		ops->exit(&init_net);
+	free(init_net.gen[*ops->id]);
+	init_net.gen[*ops->id] = NULL;
+	pernet_ops[*ops->id] = NULL;
+}
+
+/* Tear down and set up init_net again, so that no state a run left in the
+ * namespace (e.g. cached per-destination models) leaks into the next run.
+ */
+void netns_reset(void)
+{
+	unsigned int i;
+
+	memset(sim_ehash, 0, sizeof(sim_ehash));
+
+	for (i = 0; i < pernet_ids; i++) {
+		struct pernet_operations *ops = pernet_ops[i];
+
+		if (!ops)
+			continue;
+		if (ops->exit)
+			ops->exit(&init_net);
+		memset(init_net.gen[i], 0, ops->size);
+		if (ops->init && ops->init(&init_net))
+			abort();
+	}
+}
+
+void print_proc_files(void)
+{
+	struct seq_file seq = { .f = stdout };
+	unsigned int i;
+
+	for (i = 0; i < MAX_PROC_FILES; i++) {
+		if (!proc_files[i].name)
+			continue;
+		printf("/proc/net/%s:\n", proc_files[i].name);
+		proc_file_show(&proc_files[i], &seq);
+	}
+}
+
+static struct tcp_congestion_ops *ca_registry[MAX_CA];
+
+int tcp_register_congestion_control(struct tcp_congestion_ops *ops)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(ca_registry); i++) {
+		if (!ca_registry[i]) {
+			ca_registry[i] = ops;
+			return 0;
+		}
+	}
+	return -ENOSPC;
+}
+
+void tcp_unregister_congestion_control(struct tcp_congestion_ops *ops)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(ca_registry); i++)
+		if (ca_registry[i] == ops)
+			ca_registry[i] = NULL;
+}
+
+struct tcp_congestion_ops *ca_find(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(ca_registry); i++)
+		if (ca_registry[i] && !strcmp(ca_registry[i]->name, name))
+			return ca_registry[i];
+	return NULL;
+}
+
+static struct {
+	const char *name;
+	void *addr;
+	size_t size;
+} params[MAX_PARAMS];
+static int nr_params;
+
+void sim_register_param(const char *name, void *addr, size_t size)
+{
+	if (nr_params < MAX_PARAMS)
+		params[nr_params++] = (typeof(params[0])){ name, addr, size };
+}
+
+int set_param(const char *arg)
+{
+	const char *eq = strchr(arg, '=');
+	long val;
+	int i;
+
+	if (!eq)
+		return -EINVAL;
+	val = strtol(eq + 1, NULL, 0);
+	for (i = 0; i < nr_params; i++) {
+		if (strlen(params[i].name) != (size_t)(eq - arg) ||
+		    strncmp(params[i].name, arg, eq - arg))
+			continue;
+		if (params[i].size == sizeof(int))
+			*(int *)params[i].addr = val;
+		else if (params[i].size == sizeof(bool))
+			*(bool *)params[i].addr = val;
+		else
+			return -EINVAL;
+		return 0;
+	}
+	return -ENOENT;
+}
+
+u64 rng_seed = 0x9e3779b97f4a7c15ULL;	/* -S */
+u64 rng_state;
+
+/* Seed from a -S value: a splitmix64 step, so that nearby values give
+ * unrelated streams. xorshift64* needs a nonzero state.
+ */
+u64 rng_seed_from(u64 val)
+{
+	u64 z = val + 0x9e3779b97f4a7c15ULL;
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	z ^= z >> 31;
+	return z ? z : 1;
+}
+
+u64 rng_next(void)
+{
+	/* xorshift64*: deterministic across runs for a given seed */
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545f4914f6cdd1dULL;
+}
+
+u32 get_random_u32(void)
+{
+	return rng_next() >> 32;
+}
+
+void sim_log(const char *fmt, ...)
+{
+	va_list ap;
+
+	if (verbose < 2)
+		return;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+
+/* ---------------- Reno, for competing flows ---------------- */
+
+struct reno {
+	u32 cwnd_cnt;
+	u32 prior_cwnd;
+};
+
+static void reno_init(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+
+	memset(inet_csk_ca(sk), 0, sizeof(struct reno));
+	tp->snd_cwnd = TCP_INIT_CWND;
+}
+
+static u32 reno_ssthresh(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct reno *ca = inet_csk_ca(sk);
+
+	ca->prior_cwnd = tp->snd_cwnd;
+	return max(tp->snd_cwnd >> 1U, 2U);
+}
+
+static void reno_cong_avoid(struct sock *sk, u32 ack, u32 acked)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct reno *ca = inet_csk_ca(sk);
+
+	if (!tp->is_cwnd_limited)
+		return;
+	if (tp->snd_cwnd < tp->snd_ssthresh) {
+		tp->snd_cwnd = min(tp->snd_cwnd + acked, tp->snd_ssthresh);
+		return;
+	}
+	ca->cwnd_cnt += acked;
+	if (ca->cwnd_cnt >= tp->snd_cwnd) {
+		ca->cwnd_cnt -= tp->snd_cwnd;
+		tp->snd_cwnd++;
+	}
+}
+
+static u32 reno_undo_cwnd(struct sock *sk)
+{
+	struct reno *ca = inet_csk_ca(sk);
+
+	return max(tcp_sk(sk)->snd_cwnd, ca->prior_cwnd);
+}
+
+struct tcp_congestion_ops sim_reno = {
+	.name		= "reno",
+	.init		= reno_init,
+	.ssthresh	= reno_ssthresh,
+	.cong_avoid	= reno_cong_avoid,
+	.undo_cwnd	= reno_undo_cwnd,
+};
@@ -0,0 +1,26 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/* Host-side interface of sim_env.c */
+#ifndef SIM_ENV_H
+#define SIM_ENV_H
+
+#include "sim_tcp.h"
+
+extern int verbose;		/* sim_log() prints at 2 and above */
+extern u64 rng_seed, rng_state;
+extern struct tcp_congestion_ops sim_reno;
+
+/* module_init() of tcp_bbr3.c */
+int sim_module_init(void);
+
+void netns_reset(void);
+void sim_ehash_add(struct sock *sk);	/* connected sockets of init_net */
+void sim_ehash_del(struct sock *sk);
+void print_proc_files(void);
+int proc_file_read(const char *name, FILE *f);
+int proc_file_write(const char *name, char *buf, size_t len);	/* NUL-terminated */
+struct tcp_congestion_ops *ca_find(const char *name);
+int set_param(const char *arg);	/* "name=value" */
+u64 rng_seed_from(u64 val);
+u64 rng_next(void);
+
+#endif /* SIM_ENV_H */
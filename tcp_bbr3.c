@@ -13,280 +13,846 @@
 #include <linux/init.h>
 #include <linux/tcp.h>
 #include <linux/inet_diag.h>
+#include <linux/jhash.h>
+#include <linux/list.h>
 #include <linux/random.h>
+#include <linux/rcupdate.h>
+#include <linux/math64.h>
+#include <linux/percpu.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/seq_file_net.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/sysctl.h>
+#include <linux/version.h>
 #include <net/tcp.h>
 #include <net/inet_connection_sock.h>
+#include <net/ipv6.h>
+#include <net/net_namespace.h>
+#include <net/netns/generic.h>
 
-#define BBRV3_VERSION "3.0"
-
-/* BBR constants */
-#define BBR_SCALE 8	/* scaling factor for fractions: 1/256 */
-#define BBR_UNIT (1 << BBR_SCALE)
-#define BW_SCALE 24
-#define BW_UNIT (1 << BW_SCALE)
-
-/* Fallback for older kernels */
-#ifndef tcp_jiffies32
-#define tcp_jiffies32 jiffies
-#endif
-
-#ifndef tcp_init_cwnd
-static inline u32 tcp_init_cwnd(const struct tcp_sock *tp, const struct dst_entry *dst)
-{
-	return min_t(u32, 10, max_t(u32, 2, 4380 / tp->mss_cache));
-}
-#endif
+#define CREATE_TRACE_POINTS
+#include "tcp_bbr3_trace.h"
+#include "tcp_bbr3.h"
 
-#ifndef tcp_cwnd_reduction_target
-static inline u32 tcp_cwnd_reduction_target(const struct tcp_sock *tp)
-{
-	return max_t(u32, tp->snd_cwnd >> 1, 2);
-}
-#endif
+#define BBRV3_VERSION "3.0"
 
 /* BBRv3 module parameters */
 static int bbr_mode __read_mostly = 2;  /* 0=BBRv1, 1=BBRv2, 2=BBRv3 */
-module_param(bbr_mode, int, 0644);
-MODULE_PARM_DESC(bbr_mode, "BBR version (0=BBRv1, 1=BBRv2, 2=BBRv3)");
+module_param(bbr_mode, int, 0444);
+MODULE_PARM_DESC(bbr_mode, "BBR version run by \"bbr3\", read at load time (0=BBRv1, 1=BBRv2, 2=BBRv3)");
 
+/* The parameters below are only defaults for the per-netns sysctls under
+ * net.ipv4.tcp_bbr3, which are what sockets actually use.
+ */
 static int fast_convergence __read_mostly = 1;
-module_param(fast_convergence, int, 0644);
-MODULE_PARM_DESC(fast_convergence, "Enable fast convergence");
+module_param(fast_convergence, int, 0444);
+MODULE_PARM_DESC(fast_convergence, "Default: end PROBE_UP at the inflight_hi that caused loss last time (BBRv2/v3)");
 
 static int drain_to_target __read_mostly = 1;
-module_param(drain_to_target, int, 0644);
-MODULE_PARM_DESC(drain_to_target, "Enable drain to target");
+module_param(drain_to_target, int, 0444);
+MODULE_PARM_DESC(drain_to_target, "Default: drain to the BDP in PROBE_DOWN, not just for a round trip (BBRv2/v3)");
+
+static int coexist __read_mostly;
+module_param(coexist, int, 0444);
+MODULE_PARM_DESC(coexist, "Default: detect loss-based flows (Reno, CUBIC) sharing the bottleneck and adapt to take a fair share against them (BBRv2/v3)");
 
 static int min_rtt_win_sec __read_mostly = 5;
-module_param(min_rtt_win_sec, int, 0644);
-MODULE_PARM_DESC(min_rtt_win_sec, "Min RTT filter window length (sec)");
-
-/* BBRv3 states */
-enum bbr_mode {
-	BBR_STARTUP,
-	BBR_DRAIN,
-	BBR_PROBE_BW,
-	BBR_PROBE_RTT,
+module_param(min_rtt_win_sec, int, 0444);
+MODULE_PARM_DESC(min_rtt_win_sec, "Default min RTT filter window length (sec)");
+
+static int probe_rtt_mode_ms __read_mostly = 200;
+module_param(probe_rtt_mode_ms, int, 0444);
+MODULE_PARM_DESC(probe_rtt_mode_ms, "Default min time to hold inflight low in PROBE_RTT, 0 disables PROBE_RTT (ms)");
+
+static int warm_start_sec __read_mostly;
+module_param(warm_start_sec, int, 0444);
+MODULE_PARM_DESC(warm_start_sec, "Default age limit of the per-destination model used to warm start new connections, 0 disables warm starts (sec)");
+
+/* Per-netns tunables, set through /proc/sys/net/ipv4/tcp_bbr3/. A socket
+ * copies them into struct bbr3 at init, so changes apply to new sockets and
+ * the ACK path never leaves socket-local memory to read them.
+ */
+struct bbr3_net {
+	int fast_convergence;
+	int drain_to_target;
+	int coexist;
+	int min_rtt_win_sec;
+	int probe_rtt_mode_ms;
+	int warm_start_sec;
+	struct ctl_table *sysctl_table;
+	struct ctl_table_header *sysctl_hdr;
 };
 
-/* BBRv3 congestion control structure - optimized for size */
-struct bbr3 {
-	u32 min_rtt_us;                  /* min RTT in min_rtt_win_sec window */
-	u32 min_rtt_stamp;               /* timestamp of min_rtt_us */
-	u32 probe_rtt_done_stamp;        /* end time for PROBE_RTT */
-	u32 full_bandwidth;              /* value of full bandwidth */
-	u32 target_cwnd;                 /* target cwnd for pacing */
-	u32 prior_cwnd;                  /* prior cwnd */
-	u32 cycle_start;                 /* start of pacing gain cycle */
-	u16 pacing_gain;                 /* current pacing gain */
-	u16 cwnd_gain;                   /* current cwnd gain */
-	u8  mode;                        /* current BBR mode */
-	u8  prev_ca_state;               /* CA state on previous ACK */
-	u8  full_bandwidth_reached:1,    /* reached full bandwidth? */
-	    round_start:1,               /* start of packet-timed round? */
-	    packet_conservation:1,       /* use packet conservation? */
-	    probe_rtt_round_done:1,      /* a BBR_PROBE_RTT round at 4 pkts? */
-	    has_seen_rtt:1,              /* have we seen an RTT sample yet? */
-	    unused:3;
-	u8  full_bandwidth_count;        /* number of full bandwidth measurements */
+static unsigned int bbr3_net_id __read_mostly;
+
+/* Ranges of the tunables, sized to their fields in struct bbr3 */
+static int bbr3_min_rtt_win_sec_min = 1;
+static int bbr3_min_rtt_win_sec_max = 120;
+static int bbr3_probe_rtt_mode_ms_max = 1000;
+static int bbr3_warm_start_sec_max = 3600;
+
+/* PROBE_BW phase or other mode, as reported in tcp_bbr3_info.bbr_phase */
+enum bbr3_diag_phase {
+	BBR3_PHASE_INVALID		= 0,
+	BBR3_PHASE_STARTUP		= 1,
+	BBR3_PHASE_DRAIN		= 2,
+	BBR3_PHASE_PROBE_RTT		= 3,
+	BBR3_PHASE_PROBE_BW_UP		= 4,
+	BBR3_PHASE_PROBE_BW_DOWN	= 5,
+	BBR3_PHASE_PROBE_BW_CRUISE	= 6,
+	BBR3_PHASE_PROBE_BW_REFILL	= 7,
 };
 
-/* BBRv3 pacing gains for different modes */
-static const int bbr_pacing_gain[] = {
-	BBR_UNIT * 5 / 4,	/* probe for more available bw */
-	BBR_UNIT * 3 / 4,	/* drain queue and/or yield bw to other flows */
-	BBR_UNIT, BBR_UNIT, BBR_UNIT,	/* cruise at 1.0*bw to utilize pipe, */
-	BBR_UNIT, BBR_UNIT, BBR_UNIT	/* without creating excess queue... */
+/* INET_DIAG_BBRINFO payload: tcp_bbr_info, then the model state in the
+ * layout of the out-of-tree BBRv2/v3 tcp_bbr_info (up to bbr_extra_acked),
+ * then fields only this module reports. Rates are in bytes/sec, split in
+ * 32-bit halves; gains are scaled by BBR_UNIT, as in tcp_bbr_info.
+ *
+ * Stock kernels size union tcp_cc_info for tcp_bbr_info alone, kernels with
+ * the out-of-tree BBR patches for the layout up to bbr_extra_acked. Each
+ * ss and sock_diag consumer gets the longest prefix the union has room for.
+ */
+struct tcp_bbr3_info {
+	struct tcp_bbr_info bbr;	/* bw = bw currently in use */
+	__u32 bbr_bw_hi_lsb;		/* lower 32 bits of max filtered bw */
+	__u32 bbr_bw_hi_msb;		/* upper 32 bits of max filtered bw */
+	__u32 bbr_bw_lo_lsb;		/* lower 32 bits of bw_lo */
+	__u32 bbr_bw_lo_msb;		/* upper 32 bits of bw_lo */
+	__u8 bbr_mode;			/* current BBR mode */
+	__u8 bbr_phase;			/* enum bbr3_diag_phase */
+	__u8 unused1;
+	__u8 bbr_version;		/* BBR version: 1, 2 or 3 */
+	__u32 bbr_inflight_lo;		/* lower bound of inflight, packets */
+	__u32 bbr_inflight_hi;		/* upper bound of inflight, packets */
+	__u32 bbr_extra_acked;		/* max excess packets ACKed in epoch */
+	__u32 bbr_round_count;		/* packet-timed rounds elapsed */
+	__u16 bbr_ecn_alpha;		/* EWMA of CE mark fraction, << 8 */
+	__u8 bbr_full_bw_reached;	/* STARTUP has found the bottleneck bw */
+	__u8 bbr_lt_use_bw;		/* pacing at a detected policer's rate */
 };
 
-static const int bbr_high_gain  = BBR_UNIT * 2885 / 1000 + 1;
-static const int bbr_drain_gain = BBR_UNIT * 1000 / 2885;
-static const int bbr_cwnd_gain  = BBR_UNIT * 2;
+/* Host-wide event counters, summed over all bbr3 sockets and versions. They
+ * are per-CPU so the ACK path never writes a shared cache line; readers of
+ * /proc/net/tcp_bbr3_stat sum the CPUs. The pacing rate histogram counts
+ * packet-timed rounds by the pacing rate at the end of the round, in
+ * power-of-two Mbit/sec buckets: bucket 0 is < 1, bucket i >= 2^(i-1).
+ */
+static const char * const bbr3_stat_names[BBR3_STAT_MAX] = {
+	[BBR3_STAT_INIT]		= "init",
+	[BBR3_STAT_STARTUP_EXIT]	= "startup_exit",
+	[BBR3_STAT_PROBE_RTT]		= "probe_rtt",
+	[BBR3_STAT_INFLIGHT_HI_CUT]	= "inflight_hi_cut",
+	[BBR3_STAT_POLICER]		= "policer",
+	[BBR3_STAT_WARM_START]		= "warm_start",
+	[BBR3_STAT_CKPT_RESTORE]	= "ckpt_restore",
+};
 
-/* BBRv3 congestion control algorithm specific functions */
-static void bbr3_init(struct sock *sk)
+struct bbr3_stats {
+	unsigned long items[BBR3_STAT_MAX];
+	unsigned long pacing_hist[BBR3_PACING_HIST_BUCKETS];
+};
+
+static DEFINE_PER_CPU(struct bbr3_stats, bbr3_stats);
+
+static void bbr3_stat_inc(enum bbr3_stat_item item)
 {
-	struct tcp_sock *tp = tcp_sk(sk);
-	struct bbr3 *bbr = inet_csk_ca(sk);
-	
-	/* Initialize the BBRv3 state variables to default values */
-	memset(bbr, 0, sizeof(*bbr));
-	
-	bbr->min_rtt_us = ~0U;
-	bbr->min_rtt_stamp = tcp_jiffies32;
-	bbr->probe_rtt_done_stamp = 0;
-	bbr->full_bandwidth = 0;
-	bbr->target_cwnd = 0;
-	bbr->prior_cwnd = 0;
-	bbr->cycle_start = 0;
-	bbr->pacing_gain = bbr_high_gain;
-	bbr->cwnd_gain = bbr_cwnd_gain;
-	bbr->mode = BBR_STARTUP;
-	bbr->prev_ca_state = TCP_CA_Open;
-	bbr->full_bandwidth_reached = 0;
-	bbr->round_start = 0;
-	bbr->packet_conservation = 0;
-	bbr->probe_rtt_round_done = 0;
-	bbr->has_seen_rtt = 0;
-	bbr->full_bandwidth_count = 0;
-	
-	/* Set initial congestion window */
-	tp->snd_cwnd = tcp_init_cwnd(tp, __sk_dst_get(sk));
-	
-	/* Enable pacing */
-	cmpxchg(&sk->sk_pacing_status, SK_PACING_NONE, SK_PACING_NEEDED);
+	this_cpu_inc(bbr3_stats.items[item]);
 }
 
-/* Update minimum RTT filter */
-static void bbr3_update_min_rtt(struct sock *sk, const struct rate_sample *rs)
+/* Convert a bw to bytes/sec, e.g. for export to userspace */
+static u64 bbr3_bw_bytes_per_sec(struct sock *sk, u32 bw)
 {
-	struct bbr3 *bbr = inet_csk_ca(sk);
-	bool filter_expired;
-
-	/* Track min RTT seen in the min_rtt_win_sec filter window: */
-	filter_expired = after(tcp_jiffies32,
-			       bbr->min_rtt_stamp + min_rtt_win_sec * HZ);
-	if (rs->rtt_us >= 0 &&
-	    (rs->rtt_us < bbr->min_rtt_us || filter_expired)) {
-		bbr->min_rtt_us = rs->rtt_us;
-		bbr->min_rtt_stamp = tcp_jiffies32;
+	return mul_u64_u32_shr((u64)bw * tcp_sk(sk)->mss_cache, USEC_PER_SEC,
+			       BW_SCALE);
+}
+
+/* Warm start cache. With warm_start_sec set, a closing connection leaves
+ * its bw, min_rtt and inflight_hi behind, keyed by netns and destination (the
+ * IPv4 address, or the /64 of an IPv6 one), and the next connection to that
+ * destination within warm_start_sec starts from them instead of from
+ * nothing. The table is a fixed set of 4-way buckets: lookups at init are
+ * lock-free under RCU, stores at release take the bucket lock and replace
+ * the same destination, an empty way or the least recently stored one.
+ */
+#define BBR3_CACHE_BITS	10
+#define BBR3_CACHE_WAYS	4
+
+struct bbr3_cache_entry {
+	struct rcu_head rcu;
+	const struct net *net;
+	u32 key[2];		/* destination address or prefix */
+	u16 family;
+	u32 stamp;		/* jiffies when stored */
+	u32 bw;			/* max bw, in pkts/uS << BW_SCALE */
+	u32 min_rtt_us;
+	u32 inflight_hi;	/* ~0U if the connection saw no loss/ECN */
+};
+
+struct bbr3_cache_bucket {
+	spinlock_t lock;	/* serializes stores */
+	struct bbr3_cache_entry __rcu *ways[BBR3_CACHE_WAYS];
+};
+
+static struct bbr3_cache_bucket bbr3_cache[1 << BBR3_CACHE_BITS];
+
+/* A warm started connection opens its cwnd to this fraction of the cached
+ * BDP (or of inflight_hi, if lower) and paces at the cached bw: the path may
+ * have changed since, so it starts below the old operating point and leaves
+ * STARTUP to find the rest.
+ */
+static const int bbr_warm_start_cwnd_gain = BBR_UNIT / 2;
+
+/* Fill in the cache key of the socket's destination */
+static void bbr3_cache_key(const struct sock *sk, u32 key[2], u16 *family)
+{
+#if IS_ENABLED(CONFIG_IPV6)
+	if (sk->sk_family == AF_INET6 &&
+	    !ipv6_addr_v4mapped(&sk->sk_v6_daddr)) {
+		key[0] = sk->sk_v6_daddr.s6_addr32[0];
+		key[1] = sk->sk_v6_daddr.s6_addr32[1];
+		*family = AF_INET6;
+		return;
 	}
+#endif
+	key[0] = sk->sk_daddr;
+	key[1] = 0;
+	*family = AF_INET;
 }
 
-/* Estimate the bandwidth based on how fast packets are delivered */
-static void bbr3_update_bw(struct sock *sk, const struct rate_sample *rs)
+static struct bbr3_cache_bucket *bbr3_cache_bucket(const struct net *net,
+						   const u32 key[2], u16 family)
 {
-	struct bbr3 *bbr = inet_csk_ca(sk);
-	u64 bw;
-
-	if (rs->delivered < 0 || rs->interval_us <= 0)
-		return; /* Not a valid observation */
-
-	/* Calculate bandwidth sample */
-	bw = (u64)rs->delivered * BW_UNIT;
-	do_div(bw, rs->interval_us);
-
-	/* Update full bandwidth estimate */
-	if (!bbr->full_bandwidth_reached) {
-		if (bw >= bbr->full_bandwidth) {
-			bbr->full_bandwidth = bw;
-			bbr->full_bandwidth_count = 0;
-		} else {
-			bbr->full_bandwidth_count++;
-			if (bbr->full_bandwidth_count >= 3)
-				bbr->full_bandwidth_reached = 1;
+	u32 hash = jhash_3words(key[0], key[1], family, net_hash_mix(net));
+
+	return &bbr3_cache[hash >> (32 - BBR3_CACHE_BITS)];
+}
+
+static bool bbr3_cache_match(const struct bbr3_cache_entry *e,
+			     const struct net *net, const u32 key[2],
+			     u16 family)
+{
+	return e->net == net && e->family == family &&
+	       e->key[0] == key[0] && e->key[1] == key[1];
+}
+
+/* Copy out the entry for the socket's destination, if there is one no
+ * older than max_age jiffies.
+ */
+static bool bbr3_cache_lookup(const struct sock *sk, u32 max_age,
+			      struct bbr3_cache_entry *out)
+{
+	const struct net *net = sock_net(sk);
+	struct bbr3_cache_bucket *b;
+	struct bbr3_cache_entry *e;
+	bool found = false;
+	u32 key[2];
+	u16 family;
+	int i;
+
+	bbr3_cache_key(sk, key, &family);
+	b = bbr3_cache_bucket(net, key, family);
+
+	rcu_read_lock();
+	for (i = 0; i < BBR3_CACHE_WAYS; i++) {
+		e = rcu_dereference(b->ways[i]);
+		if (e && bbr3_cache_match(e, net, key, family)) {
+			if (tcp_jiffies32 - e->stamp <= max_age) {
+				*out = *e;
+				found = true;
+			}
+			break;
 		}
 	}
+	rcu_read_unlock();
+	return found;
 }
 
-/* BBRv3 state machine */
-static void bbr3_update_model(struct sock *sk, const struct rate_sample *rs)
+/* Store the model of a closing connection. full_bw says whether bw is a
+ * full bw estimate; if not, the connection never filled the pipe and bw is
+ * only a lower bound, so it may raise but not lower a fresh cached bw.
+ */
+static void bbr3_cache_store(struct sock *sk, u32 bw, u32 min_rtt_us,
+			     u32 inflight_hi, bool full_bw, u32 max_age)
 {
-	struct bbr3 *bbr = inet_csk_ca(sk);
-	
-	bbr3_update_bw(sk, rs);
-	bbr3_update_min_rtt(sk, rs);
-	
-	/* Simple state transitions for demo */
-	switch (bbr->mode) {
-	case BBR_STARTUP:
-		if (bbr->full_bandwidth_reached) {
-			bbr->mode = BBR_DRAIN;
-			bbr->pacing_gain = bbr_drain_gain;
-			bbr->cwnd_gain = bbr_high_gain;
+	const struct net *net = sock_net(sk);
+	struct bbr3_cache_entry *new, *e, *old = NULL;
+	struct bbr3_cache_bucket *b;
+	u32 now = tcp_jiffies32, age, oldest = 0;
+	int i, victim = -1;
+
+	new = kmalloc(sizeof(*new), GFP_ATOMIC);
+	if (!new)
+		return;
+	new->net = net;
+	bbr3_cache_key(sk, new->key, &new->family);
+	new->stamp = now;
+	new->bw = bw;
+	new->min_rtt_us = min_rtt_us;
+	new->inflight_hi = inflight_hi;
+	b = bbr3_cache_bucket(net, new->key, new->family);
+
+	spin_lock_bh(&b->lock);
+	for (i = 0; i < BBR3_CACHE_WAYS; i++) {
+		e = rcu_dereference_protected(b->ways[i],
+					      lockdep_is_held(&b->lock));
+		if (e && bbr3_cache_match(e, net, new->key, new->family)) {
+			victim = i;
+			if (!full_bw && now - e->stamp <= max_age)
+				new->bw = max(new->bw, e->bw);
+			break;
 		}
-		break;
-	case BBR_DRAIN:
-		if (tcp_packets_in_flight(tcp_sk(sk)) <= 
-		    tcp_cwnd_reduction_target(tcp_sk(sk))) {
-			bbr->mode = BBR_PROBE_BW;
-			bbr->pacing_gain = BBR_UNIT;
-			bbr->cwnd_gain = BBR_UNIT;
+		age = e ? now - e->stamp : ~0U;
+		if (victim < 0 || age > oldest) {
+			victim = i;
+			oldest = age;
 		}
-		break;
-	case BBR_PROBE_BW:
-		/* Stay in PROBE_BW for simplicity */
-		break;
-	case BBR_PROBE_RTT:
-		/* Simplified PROBE_RTT */
-		if (after(tcp_jiffies32, bbr->probe_rtt_done_stamp)) {
-			bbr->mode = BBR_PROBE_BW;
-			bbr->pacing_gain = BBR_UNIT;
+	}
+	old = rcu_dereference_protected(b->ways[victim],
+					lockdep_is_held(&b->lock));
+	rcu_assign_pointer(b->ways[victim], new);
+	spin_unlock_bh(&b->lock);
+
+	if (old)
+		kfree_rcu(old, rcu);
+}
+
+/* Drop the entries of a netns that is going away */
+static void bbr3_cache_flush(const struct net *net)
+{
+	struct bbr3_cache_entry *e;
+	int i, j;
+
+	for (i = 0; i < ARRAY_SIZE(bbr3_cache); i++) {
+		struct bbr3_cache_bucket *b = &bbr3_cache[i];
+
+		spin_lock_bh(&b->lock);
+		for (j = 0; j < BBR3_CACHE_WAYS; j++) {
+			e = rcu_dereference_protected(b->ways[j],
+						      lockdep_is_held(&b->lock));
+			if (e && e->net == net) {
+				RCU_INIT_POINTER(b->ways[j], NULL);
+				kfree_rcu(e, rcu);
+			}
 		}
-		break;
+		spin_unlock_bh(&b->lock);
 	}
 }
 
-/* Update congestion window */
-static void bbr3_set_cwnd(struct sock *sk, const struct rate_sample *rs,
-			  u32 acked, u32 bw, int gain)
+static void bbr3_cache_init(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(bbr3_cache); i++)
+		spin_lock_init(&bbr3_cache[i].lock);
+}
+
+/* Seed cwnd and the pacing rate of a new connection from the cache. Only
+ * the starting point changes: the model filters start empty and STARTUP
+ * still runs, so a path that got worse is measured afresh.
+ */
+static void bbr3_warm_start(struct sock *sk, u32 max_age)
 {
 	struct tcp_sock *tp = tcp_sk(sk);
-	struct bbr3 *bbr = inet_csk_ca(sk);
-	u32 cwnd = 0, target_cwnd = 0;
+	struct bbr3_cache_entry e;
+	unsigned long rate;
+	u64 cwnd;
 
-	if (!acked)
-		goto done;
+	if (!bbr3_cache_lookup(sk, max_age, &e))
+		return;
 
-	if (bbr->mode == BBR_STARTUP) {
-		/* In startup, grow cwnd exponentially */
-		cwnd = tp->snd_cwnd + acked;
-	} else {
-		/* Calculate target cwnd based on BDP */
-		if (bbr->min_rtt_us < ~0U && bw) {
-			target_cwnd = (u64)bw * bbr->min_rtt_us / BW_UNIT;
-			target_cwnd = (target_cwnd * gain) >> BBR_SCALE;
-			target_cwnd += 3 * tp->mss_cache; /* headroom */
-			cwnd = min(target_cwnd, tp->snd_cwnd + acked);
-		} else {
-			cwnd = tp->snd_cwnd + acked;
+	cwnd = (u64)e.bw * e.min_rtt_us >> BW_SCALE;
+	cwnd = min_t(u64, cwnd, e.inflight_hi);
+	cwnd = (cwnd * bbr_warm_start_cwnd_gain) >> BBR_SCALE;
+	if (cwnd <= tp->snd_cwnd)
+		return;
+	tp->snd_cwnd = min_t(u64, cwnd, tp->snd_cwnd_clamp);
+
+	rate = bbr3_bw_to_pacing_rate(sk, e.bw, BBR_UNIT);
+	if (rate > READ_ONCE(sk->sk_pacing_rate))
+		WRITE_ONCE(sk->sk_pacing_rate, rate);
+	bbr3_stat_inc(BBR3_STAT_WARM_START);
+}
+
+/* Migration checkpoints. Reading /proc/net/tcp_bbr3_ckpt checkpoints the
+ * model of each connection that CRIU, or anything else using TCP_REPAIR,
+ * holds in repair mode, keyed by netns and 4-tuple. The connection restored
+ * in repair mode with the same 4-tuple picks it up at init and resumes at
+ * the rate it had, rather than from STARTUP. Between hosts or namespaces
+ * the checkpoints move as text through the same file: read it while the
+ * dumped sockets are still in repair mode, write it on the other side
+ * before they are restored. Times travel as ages, so they rebase onto the
+ * clock of the reader. A checkpoint is used once; unused ones expire after
+ * BBR3_CKPT_MAX_AGE.
+ */
+#define BBR3_CKPT_BITS		10
+#define BBR3_CKPT_MAX		65536
+#define BBR3_CKPT_MAX_AGE	(600 * HZ)
+
+struct bbr3_ckpt_key {
+	__be32 saddr[4];	/* IPv6, or IPv4-mapped */
+	__be32 daddr[4];
+	u16 sport;
+	u16 dport;
+};
+
+struct bbr3_ckpt {
+	struct hlist_node node;
+	const struct net *net;
+	struct bbr3_ckpt_key key;
+	u32 stamp;		/* jiffies when stored */
+	u8 version;		/* enum bbr_version */
+	u8 full_bw_reached;
+	u8 lt_use_bw;
+	u32 bw_hi[2];		/* as in struct bbr3, pkts/uS << BW_SCALE */
+	u32 bw_lo;
+	u32 full_bw;
+	u32 lt_bw;
+	u32 min_rtt_us;
+	u32 min_rtt_stamp;	/* jiffies */
+	u32 inflight_hi;
+	u32 inflight_lo;
+	u16 extra_acked;
+	u16 ecn_alpha;
+};
+
+static struct hlist_head bbr3_ckpt_table[1 << BBR3_CKPT_BITS];
+static DEFINE_SPINLOCK(bbr3_ckpt_lock);	/* the table and the count */
+static unsigned int bbr3_ckpt_count;
+
+static void bbr3_ckpt_key(const struct sock *sk, struct bbr3_ckpt_key *key)
+{
+	memset(key, 0, sizeof(*key));
+#if IS_ENABLED(CONFIG_IPV6)
+	if (sk->sk_family == AF_INET6) {
+		memcpy(key->saddr, &sk->sk_v6_rcv_saddr, sizeof(key->saddr));
+		memcpy(key->daddr, &sk->sk_v6_daddr, sizeof(key->daddr));
+	} else
+#endif
+	{
+		key->saddr[2] = htonl(0xffff);
+		key->saddr[3] = sk->sk_rcv_saddr;
+		key->daddr[2] = htonl(0xffff);
+		key->daddr[3] = sk->sk_daddr;
+	}
+	key->sport = sk->sk_num;
+	key->dport = ntohs(sk->sk_dport);
+}
+
+static struct hlist_head *bbr3_ckpt_head(const struct net *net,
+					 const struct bbr3_ckpt_key *key)
+{
+	u32 hash = jhash2((const u32 *)key, sizeof(*key) / sizeof(u32),
+			  net_hash_mix(net));
+
+	return &bbr3_ckpt_table[hash >> (32 - BBR3_CKPT_BITS)];
+}
+
+static bool bbr3_ckpt_expired(const struct bbr3_ckpt *c, u32 now)
+{
+	return now - c->stamp > BBR3_CKPT_MAX_AGE;
+}
+
+/* Drop the checkpoints of net, or with net NULL the expired ones of any
+ * netns. Called with bbr3_ckpt_lock held.
+ */
+static void bbr3_ckpt_purge(const struct net *net)
+{
+	struct hlist_node *tmp;
+	struct bbr3_ckpt *c;
+	u32 now = tcp_jiffies32;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(bbr3_ckpt_table); i++) {
+		hlist_for_each_entry_safe(c, tmp, &bbr3_ckpt_table[i], node) {
+			if (net ? c->net != net : !bbr3_ckpt_expired(c, now))
+				continue;
+			hlist_del(&c->node);
+			bbr3_ckpt_count--;
+			kfree(c);
 		}
 	}
+}
 
-	cwnd = max(cwnd, 4U);
-	tp->snd_cwnd = min(cwnd, tp->snd_cwnd_clamp);
+/* Look up the checkpoint of a connection and unlink it. Called with
+ * bbr3_ckpt_lock held.
+ */
+static struct bbr3_ckpt *bbr3_ckpt_unlink(const struct net *net,
+					  const struct bbr3_ckpt_key *key)
+{
+	struct bbr3_ckpt *c;
 
-done:
-	bbr->target_cwnd = target_cwnd;
+	hlist_for_each_entry(c, bbr3_ckpt_head(net, key), node) {
+		if (c->net == net && !memcmp(&c->key, key, sizeof(*key))) {
+			hlist_del(&c->node);
+			bbr3_ckpt_count--;
+			return c;
+		}
+	}
+	return NULL;
 }
 
-/* Main BBRv3 algorithm */
-static void bbr3_main(struct sock *sk, const struct rate_sample *rs)
+/* Add a checkpoint in place of any of the same connection. When the table
+ * is full, expired checkpoints make room; if none has, the new one is
+ * refused.
+ */
+static int bbr3_ckpt_insert(struct bbr3_ckpt *new)
 {
-	struct bbr3 *bbr = inet_csk_ca(sk);
-	u32 bw;
+	struct bbr3_ckpt *old;
+	int err = 0;
 
-	bbr3_update_model(sk, rs);
+	spin_lock_bh(&bbr3_ckpt_lock);
+	old = bbr3_ckpt_unlink(new->net, &new->key);
+	if (bbr3_ckpt_count >= BBR3_CKPT_MAX)
+		bbr3_ckpt_purge(NULL);
+	if (bbr3_ckpt_count < BBR3_CKPT_MAX) {
+		hlist_add_head(&new->node, bbr3_ckpt_head(new->net, &new->key));
+		bbr3_ckpt_count++;
+	} else {
+		err = -ENOSPC;
+	}
+	spin_unlock_bh(&bbr3_ckpt_lock);
 
-	bw = bbr->full_bandwidth;
-	bbr3_set_cwnd(sk, rs, rs->acked_sacked, bw, bbr->cwnd_gain);
+	kfree(old);
+	return err;
 }
 
-/* Implementation of required TCP congestion control operations */
-static u32 bbr3_ssthresh(struct sock *sk)
+/* Checkpoint a connection in repair mode. Everything comes from the model
+ * itself, since the restored socket starts over with cwnd and the RTT
+ * estimators. A connection that has no min_rtt or bw sample yet has
+ * nothing to offer.
+ */
+static void bbr3_ckpt_store(struct sock *sk)
 {
-	return tcp_sk(sk)->snd_ssthresh;
+	const struct bbr3 *bbr = inet_csk_ca(sk);
+	struct bbr3_ckpt *c;
+
+	if (bbr->min_rtt_us == ~0U || !bbr3_max_bw(sk))
+		return;
+	c = kmalloc(sizeof(*c), GFP_ATOMIC);
+	if (!c)
+		return;
+	c->net = sock_net(sk);
+	bbr3_ckpt_key(sk, &c->key);
+	c->stamp = tcp_jiffies32;
+	c->version = bbr3_sk_version(sk);
+	c->full_bw_reached = bbr->full_bandwidth_reached;
+	c->lt_use_bw = bbr->lt_use_bw;
+	c->bw_hi[0] = bbr->bw_hi[0];
+	c->bw_hi[1] = bbr->bw_hi[1];
+	c->bw_lo = bbr->bw_lo;
+	/* After STARTUP the space of full_bandwidth holds bw_latest */
+	c->full_bw = bbr->mode == BBR_STARTUP ? bbr->full_bandwidth : 0;
+	c->lt_bw = bbr->lt_bw;
+	c->min_rtt_us = bbr->min_rtt_us;
+	c->min_rtt_stamp = bbr->min_rtt_stamp;
+	c->inflight_hi = bbr->inflight_hi;
+	c->inflight_lo = bbr->inflight_lo;
+	c->extra_acked = bbr3_extra_acked(sk);
+	c->ecn_alpha = bbr->ecn_alpha;
+	if (bbr3_ckpt_insert(c))
+		kfree(c);
 }
 
-static u32 bbr3_undo_cwnd(struct sock *sk)
+/* Resume a connection restored in repair mode from its checkpoint, if it
+ * has one taken by the same BBR version. The filters and bounds carry
+ * over; the mode does not, since DRAIN, PROBE_RTT and the PROBE_BW phases
+ * are tied to the old flight of packets. A model that had left STARTUP
+ * cruises in PROBE_BW, where the next probe finds out whether the path
+ * still has the bw; one that had not stays in STARTUP. cwnd and the pacing
+ * rate, reset along with the rest of the socket, follow from the model.
+ */
+static bool bbr3_ckpt_restore(struct sock *sk)
 {
+	struct tcp_sock *tp = tcp_sk(sk);
 	struct bbr3 *bbr = inet_csk_ca(sk);
-	return max(tcp_sk(sk)->snd_cwnd, bbr->prior_cwnd);
+	enum bbr_version ver = bbr3_sk_version(sk);
+	struct bbr3_ckpt_key key;
+	struct bbr3_ckpt *c;
+	u32 cwnd;
+	bool ok;
+
+	bbr3_ckpt_key(sk, &key);
+	spin_lock_bh(&bbr3_ckpt_lock);
+	c = bbr3_ckpt_unlink(sock_net(sk), &key);
+	spin_unlock_bh(&bbr3_ckpt_lock);
+	if (!c)
+		return false;
+	ok = c->version == ver && !bbr3_ckpt_expired(c, tcp_jiffies32);
+	if (ok) {
+		bbr->bw_hi[0] = c->bw_hi[0];
+		bbr->bw_hi[1] = c->bw_hi[1];
+		bbr->bw_lo = c->bw_lo;
+		bbr->full_bandwidth = c->full_bw;
+		bbr->full_bandwidth_reached = c->full_bw_reached;
+		bbr->lt_bw = c->lt_bw;
+		bbr->lt_use_bw = c->lt_use_bw;
+		bbr->min_rtt_us = c->min_rtt_us;
+		bbr->min_rtt_stamp = c->min_rtt_stamp;
+		bbr->has_seen_rtt = 1;
+		bbr->inflight_hi = c->inflight_hi;
+		bbr->inflight_lo = c->inflight_lo;
+		bbr->extra_acked[0] = c->extra_acked;
+		bbr->ecn_alpha = c->ecn_alpha;
+	}
+	kfree(c);
+	if (!ok)
+		return false;
+
+	if (bbr->full_bandwidth_reached) {
+		bbr3_enter_probe_bw(sk, ver);
+		if (ver != BBR_V1)
+			bbr3_start_bw_probe_cruise(sk);
+	}
+	cwnd = bbr3_bdp(sk, bbr3_bw(sk), bbr->cwnd_gain) +
+	       bbr3_ack_aggregation_cwnd(sk);
+	cwnd = bbr3_quantization_budget(sk, cwnd);
+	cwnd = min(cwnd, bbr3_inflight_cap(sk));
+	tp->snd_cwnd = max(tp->snd_cwnd, min(cwnd, tp->snd_cwnd_clamp));
+	WRITE_ONCE(sk->sk_pacing_rate,
+		   bbr3_bw_to_pacing_rate(sk, bbr3_bw(sk), bbr->pacing_gain));
+	bbr3_stat_inc(BBR3_STAT_CKPT_RESTORE);
+	return true;
 }
 
-static void bbr3_cwnd_event(struct sock *sk, enum tcp_ca_event event)
+/* /proc/net/tcp_bbr3_ckpt holds one checkpoint per line: local and remote
+ * address:port as in /proc/net/tcp6, but in network byte order so it reads
+ * the same on any host, then the BBR version (1-3) and the model, with
+ * bandwidths in the units of struct bbr3 and min_rtt_stamp as an age.
+ */
+#define BBR3_CKPT_FMT							\
+	"%08X%08X%08X%08X:%04X %08X%08X%08X%08X:%04X %u %u %u %u %u %u %u %u " \
+	"%u %u %u %u %u %u\n"
+#define BBR3_CKPT_FIELDS	24
+
+static struct inet_hashinfo *bbr3_sock_hashinfo(const struct net *net)
 {
-	struct bbr3 *bbr = inet_csk_ca(sk);
-	struct tcp_sock *tp = tcp_sk(sk);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 1, 0)
+	return net->ipv4.tcp_death_row.hashinfo;
+#else
+	return &tcp_hashinfo;
+#endif
+}
+
+static size_t bbr3_get_info(struct sock *sk, u32 ext, int *attr,
+			    union tcp_cc_info *info);
+
+/* The same test of icsk_ca_ops as inet_diag, unlocked */
+static bool bbr3_sock_is_bbr3(const struct sock *sk, const struct net *net)
+{
+	return sk_fullsock(sk) && net_eq(sock_net(sk), net) &&
+	       READ_ONCE(inet_csk(sk)->icsk_ca_ops)->get_info == bbr3_get_info;
+}
+
+/* Checkpoint the bbr3 sockets of net in repair mode, as a dump leaves
+ * them, in place of any older checkpoint of theirs. This cannot wait for
+ * release: a socket closed in repair mode goes through tcp_disconnect(),
+ * which clears its ports and local address first. The model is read
+ * unlocked, as for tcp_bbr3_sock; a socket in repair mode sends nothing.
+ */
+static void bbr3_ckpt_store_repair(const struct net *net)
+{
+	struct inet_hashinfo *hinfo = bbr3_sock_hashinfo(net);
+	struct inet_ehash_bucket *head;
+	struct hlist_nulls_node *node;
+	struct sock *sk;
+	u32 bucket;
+
+	for (bucket = 0; bucket <= hinfo->ehash_mask; bucket++) {
+		head = &hinfo->ehash[bucket];
+		if (hlist_nulls_empty(&head->chain))
+			continue;
+		spin_lock_bh(inet_ehash_lockp(hinfo, bucket));
+		sk_nulls_for_each(sk, node, &head->chain) {
+			if (bbr3_sock_is_bbr3(sk, net) &&
+			    READ_ONCE(tcp_sk(sk)->repair))
+				bbr3_ckpt_store(sk);
+		}
+		spin_unlock_bh(inet_ehash_lockp(hinfo, bucket));
+	}
+}
+
+static int bbr3_ckpt_show(struct seq_file *seq, void *v)
+{
+	const struct net *net = seq_file_single_net(seq);
+	u32 now = tcp_jiffies32;
+	struct bbr3_ckpt *c;
+	int i;
 
-	if (event == CA_EVENT_TX_START && tp->app_limited) {
-		bbr->prior_cwnd = tp->snd_cwnd;
+	bbr3_ckpt_store_repair(net);
+	seq_puts(seq, "# local remote version bw_hi0 bw_hi1 bw_lo full_bw "
+		 "full_bw_reached min_rtt_us min_rtt_age_ms inflight_hi "
+		 "inflight_lo extra_acked ecn_alpha lt_bw lt_use_bw\n");
+	spin_lock_bh(&bbr3_ckpt_lock);
+	for (i = 0; i < ARRAY_SIZE(bbr3_ckpt_table); i++) {
+		hlist_for_each_entry(c, &bbr3_ckpt_table[i], node) {
+			const struct bbr3_ckpt_key *k = &c->key;
+
+			if (c->net != net || bbr3_ckpt_expired(c, now))
+				continue;
+			seq_printf(seq, BBR3_CKPT_FMT,
+				   ntohl(k->saddr[0]), ntohl(k->saddr[1]),
+				   ntohl(k->saddr[2]), ntohl(k->saddr[3]),
+				   k->sport,
+				   ntohl(k->daddr[0]), ntohl(k->daddr[1]),
+				   ntohl(k->daddr[2]), ntohl(k->daddr[3]),
+				   k->dport,
+				   c->version + 1, c->bw_hi[0], c->bw_hi[1],
+				   c->bw_lo, c->full_bw, c->full_bw_reached,
+				   c->min_rtt_us,
+				   jiffies_to_msecs(now - c->min_rtt_stamp),
+				   c->inflight_hi, c->inflight_lo,
+				   c->extra_acked, c->ecn_alpha, c->lt_bw,
+				   c->lt_use_bw);
+		}
 	}
+	spin_unlock_bh(&bbr3_ckpt_lock);
+	return 0;
 }
 
-static void bbr3_pkts_acked(struct sock *sk, const struct ack_sample *sample)
+static int bbr3_ckpt_parse(const char *line, struct bbr3_ckpt *c)
 {
-	/* Handle packet acknowledgements - placeholder for future enhancements */
+	u32 saddr[4], daddr[4], sport, dport, ver, full_bw_reached, age;
+	u32 extra_acked, ecn_alpha, lt_use_bw;
+	int i;
+
+	if (sscanf(line, BBR3_CKPT_FMT, &saddr[0], &saddr[1], &saddr[2],
+		   &saddr[3], &sport, &daddr[0], &daddr[1], &daddr[2],
+		   &daddr[3], &dport, &ver, &c->bw_hi[0], &c->bw_hi[1],
+		   &c->bw_lo, &c->full_bw, &full_bw_reached, &c->min_rtt_us,
+		   &age, &c->inflight_hi, &c->inflight_lo, &extra_acked,
+		   &ecn_alpha, &c->lt_bw, &lt_use_bw) != BBR3_CKPT_FIELDS)
+		return -EINVAL;
+	if (ver < BBR_V1 + 1 || ver > BBR_V3 + 1 || full_bw_reached > 1 ||
+	    lt_use_bw > (ver != BBR_V3 + 1) || extra_acked > U16_MAX ||
+	    ecn_alpha > BBR_UNIT ||
+	    c->min_rtt_us == ~0U || !max(c->bw_hi[0], c->bw_hi[1]))
+		return -EINVAL;
+
+	memset(&c->key, 0, sizeof(c->key));
+	for (i = 0; i < 4; i++) {
+		c->key.saddr[i] = htonl(saddr[i]);
+		c->key.daddr[i] = htonl(daddr[i]);
+	}
+	c->key.sport = sport;
+	c->key.dport = dport;
+	c->version = ver - 1;
+	c->full_bw_reached = full_bw_reached;
+	c->lt_use_bw = lt_use_bw;
+	c->extra_acked = extra_acked;
+	c->ecn_alpha = ecn_alpha;
+	/* A min_rtt older than any min_rtt window is as good as expired */
+	age = min_t(u32, age, bbr3_min_rtt_win_sec_max * MSEC_PER_SEC);
+	c->stamp = tcp_jiffies32;
+	c->min_rtt_stamp = c->stamp - msecs_to_jiffies(age);
+	return 0;
+}
+
+/* Writes add the checkpoints on each line, in the format read; blank lines
+ * and lines starting with '#' are skipped. Each write must hold whole lines.
+ */
+static int bbr3_ckpt_write(struct file *file, char *buf, size_t size)
+{
+	const struct net *net = seq_file_single_net(file->private_data);
+	struct bbr3_ckpt *c;
+	char *line;
+	int err;
+
+	while ((line = strsep(&buf, "\n"))) {
+		if (!*line || *line == '#')
+			continue;
+		c = kmalloc(sizeof(*c), GFP_KERNEL);
+		if (!c)
+			return -ENOMEM;
+		c->net = net;
+		err = bbr3_ckpt_parse(line, c);
+		if (!err)
+			err = bbr3_ckpt_insert(c);
+		if (err) {
+			kfree(c);
+			return err;
+		}
+	}
+	return 0;
+}
+
+/* BBRv3 congestion control algorithm specific functions */
+static void bbr3_init(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	const struct bbr3_net *bn;
+	u32 warm_start;
+	
+	bbr3_init_state(sk);
+
+	bn = net_generic(sock_net(sk), bbr3_net_id);
+	bbr->min_rtt_win_sec = READ_ONCE(bn->min_rtt_win_sec);
+	bbr->probe_rtt_mode_ms = READ_ONCE(bn->probe_rtt_mode_ms);
+	bbr->fast_convergence = !!READ_ONCE(bn->fast_convergence);
+	bbr->drain_to_target = !!READ_ONCE(bn->drain_to_target);
+	bbr->coexist = bbr3_sk_version(sk) != BBR_V1 && READ_ONCE(bn->coexist);
+	
+	/* Set initial congestion window */
+	tp->snd_cwnd = tcp_init_cwnd(tp, __sk_dst_get(sk));
+	bbr3_init_pacing_rate_from_rtt(sk);
+	warm_start = READ_ONCE(bn->warm_start_sec);
+	if ((!tp->repair || !bbr3_ckpt_restore(sk)) && warm_start)
+		bbr3_warm_start(sk, warm_start * HZ);
+	
+	/* Enable pacing */
+	cmpxchg(&sk->sk_pacing_status, SK_PACING_NONE, SK_PACING_NEEDED);
+}
+
+/* Count a round in the pacing rate histogram */
+static void bbr3_stat_pacing_rate(struct sock *sk)
+{
+	u64 mbps = div_u64(READ_ONCE(sk->sk_pacing_rate), 1000000 / 8);
+
+	this_cpu_inc(bbr3_stats.pacing_hist[min_t(u32, fls64(mbps),
+				BBR3_PACING_HIST_BUCKETS - 1)]);
+}
+
+static void bbr3_main_v1(struct sock *sk, const struct rate_sample *rs)
+{
+	__bbr3_main(sk, rs, BBR_V1);
+}
+
+static void bbr3_main_v2(struct sock *sk, const struct rate_sample *rs)
+{
+	__bbr3_main(sk, rs, BBR_V2);
+}
+
+static void bbr3_main_v3(struct sock *sk, const struct rate_sample *rs)
+{
+	__bbr3_main(sk, rs, BBR_V3);
+}
+
+/* cong_control of "bbr3", indexed by bbr_mode */
+static void (* const bbr3_main_by_mode[])(struct sock *sk,
+					 const struct rate_sample *rs) = {
+	[BBR_V1] = bbr3_main_v1,
+	[BBR_V2] = bbr3_main_v2,
+	[BBR_V3] = bbr3_main_v3,
+};
+
+/* Leave the bw, min_rtt and inflight_hi of the connection behind for the
+ * next one to the same destination. A connection that has no min_rtt or bw
+ * sample yet has nothing to offer.
+ */
+static void bbr3_release(struct sock *sk)
+{
+	const struct bbr3_net *bn = net_generic(sock_net(sk), bbr3_net_id);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 warm_start = READ_ONCE(bn->warm_start_sec);
+	u32 bw = bbr3_max_bw(sk);
+
+	if (bbr->min_rtt_us == ~0U || !bw)
+		return;
+	if (warm_start)
+		bbr3_cache_store(sk, bw, bbr->min_rtt_us, bbr->inflight_hi,
+				 bbr->full_bandwidth_reached, warm_start * HZ);
 }
 
 static void bbr3_cong_avoid(struct sock *sk, u32 ack, u32 acked)
@@ -294,55 +860,436 @@ static void bbr3_cong_avoid(struct sock *sk, u32 ack, u32 acked)
 	/* BBR doesn't use traditional congestion avoidance */
 }
 
+/* Which version does this socket run? Off the ACK path only. */
+static enum bbr_version bbr3_sk_version(const struct sock *sk)
+{
+	const struct tcp_congestion_ops *ops = inet_csk(sk)->icsk_ca_ops;
+	int ver;
+
+	for (ver = BBR_V1; ver < BBR_V3; ver++)
+		if (ops->cong_control == bbr3_main_by_mode[ver])
+			return ver;
+	return BBR_V3;
+}
+
+static u8 bbr3_diag_phase(const struct sock *sk, enum bbr_version ver)
+{
+	const struct bbr3 *bbr = inet_csk_ca(sk);
+
+	switch (bbr->mode) {
+	case BBR_STARTUP:
+		return BBR3_PHASE_STARTUP;
+	case BBR_DRAIN:
+		return BBR3_PHASE_DRAIN;
+	case BBR_PROBE_RTT:
+		return BBR3_PHASE_PROBE_RTT;
+	}
+	/* BBRv1 spends cycle phases 2..CYCLE_LEN-1 cruising */
+	if (ver == BBR_V1 && bbr->cycle_idx >= BBR_BW_PROBE_CRUISE)
+		return BBR3_PHASE_PROBE_BW_CRUISE;
+	switch (bbr->cycle_idx) {
+	case BBR_BW_PROBE_UP:
+		return BBR3_PHASE_PROBE_BW_UP;
+	case BBR_BW_PROBE_DOWN:
+		return BBR3_PHASE_PROBE_BW_DOWN;
+	case BBR_BW_PROBE_CRUISE:
+		return BBR3_PHASE_PROBE_BW_CRUISE;
+	case BBR_BW_PROBE_REFILL:
+		return BBR3_PHASE_PROBE_BW_REFILL;
+	}
+	return BBR3_PHASE_INVALID;
+}
+
+/* Read the model of a bbr3 socket. Everything is read straight from the
+ * socket's CA state, with no locking or allocation, so polling every socket
+ * on a busy host stays cheap.
+ */
+static void bbr3_fill_info(struct sock *sk, struct tcp_bbr3_info *info)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	enum bbr_version ver = bbr3_sk_version(sk);
+	u64 bw = bbr3_bw_bytes_per_sec(sk, bbr3_bw(sk));
+
+	info->bbr.bbr_bw_lo = (u32)bw;
+	info->bbr.bbr_bw_hi = (u32)(bw >> 32);
+	info->bbr.bbr_min_rtt = bbr->min_rtt_us;
+	info->bbr.bbr_pacing_gain = bbr->pacing_gain;
+	info->bbr.bbr_cwnd_gain = bbr->cwnd_gain;
+	bw = bbr3_bw_bytes_per_sec(sk, bbr3_max_bw(sk));
+	info->bbr_bw_hi_lsb = (u32)bw;
+	info->bbr_bw_hi_msb = (u32)(bw >> 32);
+	bw = bbr3_bw_bytes_per_sec(sk, bbr->bw_lo);
+	info->bbr_bw_lo_lsb = (u32)bw;
+	info->bbr_bw_lo_msb = (u32)(bw >> 32);
+	info->bbr_mode = bbr->mode;
+	info->bbr_phase = bbr3_diag_phase(sk, ver);
+	info->unused1 = 0;
+	info->bbr_version = ver + 1;
+	info->bbr_inflight_lo = bbr->inflight_lo;
+	info->bbr_inflight_hi = bbr->inflight_hi;
+	info->bbr_extra_acked = bbr3_extra_acked(sk);
+	info->bbr_round_count = bbr->rtt_cnt;
+	info->bbr_ecn_alpha = bbr->ecn_alpha;
+	info->bbr_full_bw_reached = bbr->full_bandwidth_reached;
+	info->bbr_lt_use_bw = bbr->lt_use_bw;
+}
+
+/* Report the model over inet_diag (ss -ti) and TCP_CC_INFO */
 static size_t bbr3_get_info(struct sock *sk, u32 ext, int *attr,
 			    union tcp_cc_info *info)
 {
 	if (ext & (1 << (INET_DIAG_BBRINFO - 1)) ||
 	    ext & (1 << (INET_DIAG_VEGASINFO - 1))) {
-		struct bbr3 *bbr = inet_csk_ca(sk);
-		struct tcp_bbr_info *bbr_info = &info->bbr;
-
-		bbr_info->bbr_bw_lo = (u32)bbr->full_bandwidth;
-		bbr_info->bbr_bw_hi = (u32)(bbr->full_bandwidth >> 32);
-		bbr_info->bbr_min_rtt = bbr->min_rtt_us;
-		bbr_info->bbr_pacing_gain = bbr->pacing_gain;
-		bbr_info->bbr_cwnd_gain = bbr->cwnd_gain;
+		struct tcp_bbr3_info bbr3_info;
+		size_t len = sizeof(bbr3_info);
+
+		if (sizeof(*info) < len)
+			len = offsetofend(struct tcp_bbr3_info, bbr_extra_acked);
+		if (sizeof(*info) < len)
+			len = sizeof(struct tcp_bbr_info);
+		bbr3_fill_info(sk, &bbr3_info);
+		memcpy(info, &bbr3_info, len);
 		*attr = INET_DIAG_BBRINFO;
-		return sizeof(*bbr_info);
+		return len;
+	}
+	return 0;
+}
+
+/* /proc/net/tcp_bbr3_sock lists the bbr3 sockets of the netns, one per line,
+ * with all of tcp_bbr3_info: the socket cookie, local and remote address as
+ * in tcp_bbr3_ckpt, then the fields in struct order, rates in bytes/sec.
+ * This is how stock kernels, whose union tcp_cc_info only has room for
+ * tcp_bbr_info, get the rest of the model.
+ *
+ * Each seq_file record is one bucket of the established hash, walked under
+ * the bucket lock as /proc/net/tcp does: a read holds one lock at a time,
+ * and needs no more buffer than one bucket's sockets take.
+ */
+#define BBR3_SOCK_FMT							\
+	"%llu %08X%08X%08X%08X:%04X %08X%08X%08X%08X:%04X %u %u %u %llu " \
+	"%llu %llu %u %u %u %u %u %u %u %u %u %u\n"
+
+static void *bbr3_sock_seq_start(struct seq_file *seq, loff_t *pos)
+{
+	const struct inet_hashinfo *hinfo =
+		bbr3_sock_hashinfo(seq_file_net(seq));
+
+	if (!*pos)
+		return SEQ_START_TOKEN;
+	return *pos <= hinfo->ehash_mask + 1 ? pos : NULL;
+}
+
+static void *bbr3_sock_seq_next(struct seq_file *seq, void *v, loff_t *pos)
+{
+	++*pos;
+	return bbr3_sock_seq_start(seq, pos);
+}
+
+static void bbr3_sock_seq_stop(struct seq_file *seq, void *v)
+{
+}
+
+static void bbr3_sock_show_one(struct seq_file *seq, struct sock *sk)
+{
+	struct tcp_bbr3_info info;
+	struct bbr3_ckpt_key k;
+	__u32 cookie[2];
+
+	sock_diag_save_cookie(sk, cookie);
+	bbr3_ckpt_key(sk, &k);
+	bbr3_fill_info(sk, &info);
+	seq_printf(seq, BBR3_SOCK_FMT,
+		   ((u64)cookie[1] << 32) | cookie[0],
+		   ntohl(k.saddr[0]), ntohl(k.saddr[1]), ntohl(k.saddr[2]),
+		   ntohl(k.saddr[3]), k.sport,
+		   ntohl(k.daddr[0]), ntohl(k.daddr[1]), ntohl(k.daddr[2]),
+		   ntohl(k.daddr[3]), k.dport,
+		   info.bbr_version, info.bbr_mode, info.bbr_phase,
+		   ((u64)info.bbr.bbr_bw_hi << 32) | info.bbr.bbr_bw_lo,
+		   ((u64)info.bbr_bw_hi_msb << 32) | info.bbr_bw_hi_lsb,
+		   ((u64)info.bbr_bw_lo_msb << 32) | info.bbr_bw_lo_lsb,
+		   info.bbr.bbr_min_rtt, info.bbr.bbr_pacing_gain,
+		   info.bbr.bbr_cwnd_gain, info.bbr_inflight_lo,
+		   info.bbr_inflight_hi, info.bbr_extra_acked,
+		   info.bbr_round_count, info.bbr_ecn_alpha,
+		   info.bbr_full_bw_reached, info.bbr_lt_use_bw);
+}
+
+static int bbr3_sock_seq_show(struct seq_file *seq, void *v)
+{
+	struct net *net = seq_file_net(seq);
+	struct inet_hashinfo *hinfo = bbr3_sock_hashinfo(net);
+	struct inet_ehash_bucket *head;
+	struct hlist_nulls_node *node;
+	struct sock *sk;
+	u32 bucket;
+
+	if (v == SEQ_START_TOKEN) {
+		seq_puts(seq, "# cookie local remote version mode phase bw "
+			 "bw_hi bw_lo min_rtt_us pacing_gain cwnd_gain "
+			 "inflight_lo inflight_hi extra_acked round_count "
+			 "ecn_alpha full_bw_reached lt_use_bw\n");
+		return 0;
+	}
+	bucket = *(loff_t *)v - 1;
+	head = &hinfo->ehash[bucket];
+	if (hlist_nulls_empty(&head->chain))
+		return 0;
+	spin_lock_bh(inet_ehash_lockp(hinfo, bucket));
+	sk_nulls_for_each(sk, node, &head->chain) {
+		if (bbr3_sock_is_bbr3(sk, net))
+			bbr3_sock_show_one(seq, sk);
+	}
+	spin_unlock_bh(inet_ehash_lockp(hinfo, bucket));
+	return 0;
+}
+
+static const struct seq_operations bbr3_sock_seq_ops = {
+	.start	= bbr3_sock_seq_start,
+	.next	= bbr3_sock_seq_next,
+	.stop	= bbr3_sock_seq_stop,
+	.show	= bbr3_sock_seq_show,
+};
+
+/* /proc/net/tcp_bbr3_stat: one "name value" pair per line */
+static int bbr3_stat_show(struct seq_file *seq, void *v)
+{
+	struct bbr3_stats sum = {};
+	int cpu, i;
+
+	for_each_possible_cpu(cpu) {
+		const struct bbr3_stats *s = per_cpu_ptr(&bbr3_stats, cpu);
+
+		for (i = 0; i < BBR3_STAT_MAX; i++)
+			sum.items[i] += READ_ONCE(s->items[i]);
+		for (i = 0; i < BBR3_PACING_HIST_BUCKETS; i++)
+			sum.pacing_hist[i] += READ_ONCE(s->pacing_hist[i]);
+	}
+
+	for (i = 0; i < BBR3_STAT_MAX; i++)
+		seq_printf(seq, "%s %lu\n", bbr3_stat_names[i], sum.items[i]);
+	for (i = 0; i < BBR3_PACING_HIST_BUCKETS; i++)
+		seq_printf(seq, "pacing_rate_mbps_%lu %lu\n",
+			   i ? 1UL << (i - 1) : 0, sum.pacing_hist[i]);
+	return 0;
+}
+
+static const struct ctl_table bbr3_sysctl_template[] = {
+	{
+		.procname	= "fast_convergence",
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= SYSCTL_ZERO,
+		.extra2		= SYSCTL_ONE,
+	},
+	{
+		.procname	= "drain_to_target",
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= SYSCTL_ZERO,
+		.extra2		= SYSCTL_ONE,
+	},
+	{
+		.procname	= "coexist",
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= SYSCTL_ZERO,
+		.extra2		= SYSCTL_ONE,
+	},
+	{
+		.procname	= "min_rtt_win_sec",
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &bbr3_min_rtt_win_sec_min,
+		.extra2		= &bbr3_min_rtt_win_sec_max,
+	},
+	{
+		.procname	= "probe_rtt_mode_ms",
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= SYSCTL_ZERO,
+		.extra2		= &bbr3_probe_rtt_mode_ms_max,
+	},
+	{
+		.procname	= "warm_start_sec",
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= SYSCTL_ZERO,
+		.extra2		= &bbr3_warm_start_sec_max,
+	},
+	{ }
+};
+
+/* New namespaces start from the module parameters */
+static int __net_init bbr3_net_init(struct net *net)
+{
+	struct bbr3_net *bn = net_generic(net, bbr3_net_id);
+	struct ctl_table *table;
+
+	bn->fast_convergence = !!fast_convergence;
+	bn->drain_to_target = !!drain_to_target;
+	bn->coexist = !!coexist;
+	bn->min_rtt_win_sec = clamp(min_rtt_win_sec, bbr3_min_rtt_win_sec_min,
+				    bbr3_min_rtt_win_sec_max);
+	bn->probe_rtt_mode_ms = clamp(probe_rtt_mode_ms, 0,
+				      bbr3_probe_rtt_mode_ms_max);
+	bn->warm_start_sec = clamp(warm_start_sec, 0, bbr3_warm_start_sec_max);
+
+	table = kmemdup(bbr3_sysctl_template, sizeof(bbr3_sysctl_template),
+			GFP_KERNEL);
+	if (!table)
+		return -ENOMEM;
+	table[0].data = &bn->fast_convergence;
+	table[1].data = &bn->drain_to_target;
+	table[2].data = &bn->coexist;
+	table[3].data = &bn->min_rtt_win_sec;
+	table[4].data = &bn->probe_rtt_mode_ms;
+	table[5].data = &bn->warm_start_sec;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 5, 0)
+	bn->sysctl_hdr = register_net_sysctl_sz(net, "net/ipv4/tcp_bbr3", table,
+					       ARRAY_SIZE(bbr3_sysctl_template) - 1);
+#else
+	bn->sysctl_hdr = register_net_sysctl(net, "net/ipv4/tcp_bbr3", table);
+#endif
+	if (!bn->sysctl_hdr) {
+		kfree(table);
+		return -ENOMEM;
+	}
+	bn->sysctl_table = table;
+
+	if (!proc_create_net_single_write("tcp_bbr3_ckpt", 0600, net->proc_net,
+					  bbr3_ckpt_show, bbr3_ckpt_write,
+					  NULL))
+		goto err_sysctl;
+	if (!proc_create_net("tcp_bbr3_sock", 0444, net->proc_net,
+			     &bbr3_sock_seq_ops, sizeof(struct seq_net_private))) {
+		remove_proc_entry("tcp_bbr3_ckpt", net->proc_net);
+		goto err_sysctl;
 	}
 	return 0;
+
+err_sysctl:
+	unregister_net_sysctl_table(bn->sysctl_hdr);
+	kfree(table);
+	return -ENOMEM;
+}
+
+static void __net_exit bbr3_net_exit(struct net *net)
+{
+	struct bbr3_net *bn = net_generic(net, bbr3_net_id);
+
+	remove_proc_entry("tcp_bbr3_sock", net->proc_net);
+	remove_proc_entry("tcp_bbr3_ckpt", net->proc_net);
+	unregister_net_sysctl_table(bn->sysctl_hdr);
+	kfree(bn->sysctl_table);
+	bbr3_cache_flush(net);
+	spin_lock_bh(&bbr3_ckpt_lock);
+	bbr3_ckpt_purge(net);
+	spin_unlock_bh(&bbr3_ckpt_lock);
 }
 
-/* Register with TCP congestion control */
-static struct tcp_congestion_ops tcp_bbr3_cong_ops __read_mostly = {
-	.flags		= TCP_CONG_NON_RESTRICTED,
-	.name		= "bbr3",
-	.owner		= THIS_MODULE,
-	.init		= bbr3_init,
-	.cong_control	= bbr3_main,
-	.ssthresh	= bbr3_ssthresh,
-	.undo_cwnd	= bbr3_undo_cwnd,
-	.cwnd_event	= bbr3_cwnd_event,
-	.pkts_acked	= bbr3_pkts_acked,
-	.cong_avoid	= bbr3_cong_avoid,
-	.get_info	= bbr3_get_info,
-	.min_tso_segs	= 1,
+static struct pernet_operations bbr3_net_ops = {
+	.init	= bbr3_net_init,
+	.exit	= bbr3_net_exit,
+	.id	= &bbr3_net_id,
+	.size	= sizeof(struct bbr3_net),
+};
+
+/* Register with TCP congestion control. "bbr3" runs the version chosen by
+ * bbr_mode; "bbr3_v1", "bbr3_v2" and "bbr3_v3" can be picked per socket with
+ * TCP_CONGESTION, e.g. to A/B the versions on one host.
+ *
+ * "bbr3_ecn" is BBRv3 for datacenters with shallow-threshold ECN marking. It
+ * negotiates ECN whatever net.ipv4.tcp_ecn says, and as a receiver echoes CE
+ * per packet, so that the sender's ecn_alpha is the CE-marked fraction and
+ * inflight is cut in proportion to it. Both ends should run it (or dctcp).
+ * Pick it per netns with net.ipv4.tcp_congestion_control, per route with
+ * "ip route ... congctl bbr3_ecn", or per socket.
+ */
+#define BBR3_CONG_OPS(_name, _main, _flags)	\
+	{					\
+	.flags		= TCP_CONG_NON_RESTRICTED | (_flags),	\
+	.name		= _name,		\
+	.owner		= THIS_MODULE,		\
+	.init		= bbr3_init,		\
+	.release	= bbr3_release,		\
+	.cong_control	= _main,		\
+	.ssthresh	= bbr3_ssthresh,	\
+	.undo_cwnd	= bbr3_undo_cwnd,	\
+	.sndbuf_expand	= bbr3_sndbuf_expand,	\
+	.cwnd_event	= bbr3_cwnd_event,	\
+	.cong_avoid	= bbr3_cong_avoid,	\
+	.get_info	= bbr3_get_info,	\
+	.min_tso_segs	= bbr3_min_tso_segs,	\
+	}
+
+static struct tcp_congestion_ops tcp_bbr3_cong_ops[] __read_mostly = {
+	BBR3_CONG_OPS("bbr3", NULL, 0),	/* cong_control set from bbr_mode */
+	BBR3_CONG_OPS("bbr3_v1", bbr3_main_v1, 0),
+	BBR3_CONG_OPS("bbr3_v2", bbr3_main_v2, 0),
+	BBR3_CONG_OPS("bbr3_v3", bbr3_main_v3, 0),
+	BBR3_CONG_OPS("bbr3_ecn", bbr3_main_v3, TCP_CONG_NEEDS_ECN),
 };
 
 /* Module initialization and cleanup */
 static int __init bbr3_register(void)
 {
+	int i, ret;
+
 	BUILD_BUG_ON(sizeof(struct bbr3) > ICSK_CA_PRIV_SIZE);
 	
+	if (bbr_mode < BBR_V1 || bbr_mode > BBR_V3) {
+		pr_err("TCP BBRv3: invalid bbr_mode %d\n", bbr_mode);
+		return -EINVAL;
+	}
+	tcp_bbr3_cong_ops[0].cong_control = bbr3_main_by_mode[bbr_mode];
+	bbr3_cache_init();
+
 	pr_info("TCP BBRv3: Bottleneck Bandwidth and RTT v%s\n", BBRV3_VERSION);
 	pr_info("TCP BBRv3: Mode set to %d (0=BBRv1, 1=BBRv2, 2=BBRv3)\n", bbr_mode);
 	
-	return tcp_register_congestion_control(&tcp_bbr3_cong_ops);
+	ret = register_pernet_subsys(&bbr3_net_ops);
+	if (ret)
+		return ret;
+
+	/* Counters are host-wide, so only the initial netns shows them */
+	if (!proc_create_single("tcp_bbr3_stat", 0444, init_net.proc_net,
+				bbr3_stat_show)) {
+		ret = -ENOMEM;
+		goto err_pernet;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(tcp_bbr3_cong_ops); i++) {
+		ret = tcp_register_congestion_control(&tcp_bbr3_cong_ops[i]);
+		if (ret)
+			goto err_unregister;
+	}
+	return 0;
+
+err_unregister:
+	while (--i >= 0)
+		tcp_unregister_congestion_control(&tcp_bbr3_cong_ops[i]);
+	remove_proc_entry("tcp_bbr3_stat", init_net.proc_net);
+err_pernet:
+	unregister_pernet_subsys(&bbr3_net_ops);
+	return ret;
 }
 
 static void __exit bbr3_unregister(void)
 {
-	tcp_unregister_congestion_control(&tcp_bbr3_cong_ops);
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(tcp_bbr3_cong_ops); i++)
+		tcp_unregister_congestion_control(&tcp_bbr3_cong_ops[i]);
+	remove_proc_entry("tcp_bbr3_stat", init_net.proc_net);
+	unregister_pernet_subsys(&bbr3_net_ops);
 }
 
 module_init(bbr3_register);
@@ -351,4 +1298,4 @@ module_exit(bbr3_unregister);
 MODULE_AUTHOR("Claude AI");
 MODULE_LICENSE("GPL");
 MODULE_VERSION(BBRV3_VERSION);
-MODULE_DESCRIPTION("TCP BBRv3 (Bottleneck Bandwidth and RTT)"); 
\ No newline at end of file
+MODULE_DESCRIPTION("TCP BBRv3 (Bottleneck Bandwidth and RTT)"); 
@@ -0,0 +1,1938 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/* BBRv3 model, shared by the kernel module (tcp_bbr3.c) and the BPF
+ * struct_ops variant (bpf/tcp_bbr3.bpf.c), so both run the same per-ACK
+ * logic.
+ *
+ * Everything here is static and works on the socket's CA private area only.
+ * The including file provides the kernel API used below (natively, or with
+ * the BPF equivalents of bpf/bbr3_bpf_compat.h), the trace_bbr3_*() events of
+ * tcp_bbr3_trace.h, and bbr3_stat_inc(), bbr3_stat_pacing_rate() and
+ * bbr3_sk_version(). It owns the tunables: a socket's copies in struct bbr3
+ * are set up by its init op, after bbr3_init_state().
+ */
+#ifndef _TCP_BBR3_H
+#define _TCP_BBR3_H
+
+/* BBR constants */
+#define BBR_SCALE 8	/* scaling factor for fractions: 1/256 */
+#define BBR_UNIT (1 << BBR_SCALE)
+#define BW_SCALE 24
+#define BW_UNIT (1 << BW_SCALE)
+
+/* Fallback for older kernels */
+#ifndef tcp_jiffies32
+#define tcp_jiffies32 jiffies
+#endif
+
+#ifndef GSO_LEGACY_MAX_SIZE
+#define GSO_LEGACY_MAX_SIZE 65536u
+#endif
+
+/* Bitfields of the socket, which the BPF variant has to read with CO-RE */
+#ifndef bbr3_ca_state
+#define bbr3_ca_state(sk)		(inet_csk(sk)->icsk_ca_state)
+#define bbr3_is_cwnd_limited(tp)	((tp)->is_cwnd_limited)
+#define bbr3_is_rwnd_limited(tp)	\
+	((tp)->chrono_type == TCP_CHRONO_RWND_LIMITED)
+#endif
+
+#ifndef tcp_init_cwnd
+static inline u32 tcp_init_cwnd(const struct tcp_sock *tp, const struct dst_entry *dst)
+{
+	return min_t(u32, 10, max_t(u32, 2, 4380 / tp->mss_cache));
+}
+#endif
+
+/* BBRv3 states */
+enum bbr_mode {
+	BBR_STARTUP,
+	BBR_DRAIN,
+	BBR_PROBE_BW,
+	BBR_PROBE_RTT,
+};
+
+/* PROBE_BW phases. Each value indexes its gain in bbr_pacing_gain[]. */
+enum bbr_pacing_gain_phase {
+	BBR_BW_PROBE_UP		= 0,	/* push up inflight to probe for bw/vol */
+	BBR_BW_PROBE_DOWN	= 1,	/* drain excess inflight from the queue */
+	BBR_BW_PROBE_CRUISE	= 2,	/* use pipe, w/ headroom in queue/pipe */
+	BBR_BW_PROBE_REFILL	= 3,	/* refill the pipe again to 100% */
+};
+
+#define CYCLE_LEN	8	/* number of phases in a BBRv1 pacing gain cycle */
+
+/* Algorithm versions. Each has its own tcp_congestion_ops whose cong_control
+ * passes the version as a constant into __always_inline model functions, so
+ * the compiler builds a specialized copy of the model per version and no
+ * version check is left on the per-ACK path.
+ *
+ * BBR_V1: no loss/ECN model; the 8-phase pacing gain cycle, a max bw filter
+ *	   over 5-10 rounds, and a 4 packet cwnd in PROBE_RTT.
+ * BBR_V2: loss/ECN model with the DOWN/CRUISE/REFILL/UP PROBE_BW cycle.
+ * BBR_V3: as BBR_V2, plus extra cwnd headroom while probing up.
+ */
+enum bbr_version {
+	BBR_V1,
+	BBR_V2,
+	BBR_V3,
+};
+
+/* BBRv3 congestion control structure - optimized for size */
+struct bbr3 {
+	u32 min_rtt_us;                  /* min RTT in min_rtt_win_sec window */
+	u32 min_rtt_stamp;               /* timestamp of min_rtt_us */
+	u32 probe_rtt_done_stamp;        /* end time for PROBE_RTT */
+	u32 bw_hi[2];                    /* max bw filter, one slot per probe cycle */
+	u32 rtt_cnt;                     /* count of packet-timed rounds elapsed */
+	u32 next_rtt_delivered;          /* scb->tx.delivered at end of round */
+	union {
+		u32 full_bandwidth;      /* STARTUP: value of full bandwidth */
+		u32 bw_latest;           /* after STARTUP: max bw sampled this
+					  * round */
+	};
+	u32 prior_cwnd;                  /* prior cwnd */
+	u32 cycle_start;                 /* start of current PROBE_BW phase (us) */
+	u32 inflight_hi;                 /* upper bound of inflight data range */
+	u32 inflight_lo;                 /* lower bound of inflight data range */
+	u32 bw_lo;                       /* lower bound on sending bandwidth */
+	u32 round_lost_start;            /* tp->lost at start of round */
+	u32 round_ce_start;              /* tp->delivered_ce at start of round */
+	u32 ack_epoch_mstamp;            /* start of ACK sampling epoch (us) */
+	u32 lt_bw;                       /* LT est delivery rate in pkts/uS << 24 */
+	u32 lt_last_delivered;           /* LT intvl start: tp->delivered */
+	u32 lt_last_stamp;               /* LT intvl start: tp->delivered_mstamp (ms) */
+	union {
+		u32 lt_last_lost;        /* LT intvl start: tp->lost */
+		u32 prior_rcv_nxt;       /* BBR_V3 receiver: rcv_nxt at last CE
+					  * event; v3 takes no LT samples */
+	};
+	u16 extra_acked[2];              /* max excess data ACKed in epoch */
+	u32 pacing_gain:10,              /* current pacing gain */
+	    cwnd_gain:10,                /* current cwnd gain */
+	    ecn_alpha:9,                 /* EWMA delivered_ce/delivered; 0..256 */
+	    ecn_eligible:1,              /* sender can use ECN (RTT, handshake)? */
+	    lt_is_sampling:1,            /* taking long-term ("LT") samples now? */
+	    lt_use_bw:1;                 /* use lt_bw as our bw estimate? */
+	u32 mode:2,                      /* current BBR mode */
+	    prev_ca_state:3,             /* CA state on previous ACK */
+	    full_bandwidth_reached:1,    /* reached full bandwidth? */
+	    full_bandwidth_count:2,      /* rounds without large bw gains */
+	    round_start:1,               /* start of packet-timed round? */
+	    packet_conservation:1,       /* use packet conservation? */
+	    probe_rtt_round_done:1,      /* a BBR_PROBE_RTT round at 4 pkts? */
+	    has_seen_rtt:1,              /* have we seen an RTT sample yet? */
+	    cycle_idx:3,                 /* current PROBE_BW phase */
+	    rounds_since_probe:6,        /* packet-timed rounds since last probe */
+	    bw_probe_samples:1,          /* rate samples reflect bw probing? */
+	    prev_probe_too_high:1,       /* did last PROBE_UP go too high? */
+	    bw_probe_up_rounds:5,        /* cwnd-limited rounds in PROBE_UP */
+	    idle_restart:1,              /* restarting after idle? */
+	    idle_drained:1,              /* idle long enough to drain queue? */
+	    coexist_rtt_high:1,          /* RTT well above min_rtt this round? */
+	    ce_state:1;                  /* receiver: last data packet had CE? */
+	u32 ack_epoch_acked:20,          /* packets (S)ACKed in sampling epoch */
+	    extra_acked_win_rtts:5,      /* age of extra_acked, in round trips */
+	    extra_acked_win_idx:1,       /* current index in extra_acked array */
+	    lt_rtt_cnt:6;                /* round trips in long-term interval */
+	u32 min_rtt_win_sec:7,           /* tunables cached from struct bbr3_net */
+	    probe_rtt_mode_ms:10,
+	    fast_convergence:1,
+	    drain_to_target:1,
+	    coexist:1,
+	    startup_loss_events:4,       /* loss events this round in STARTUP */
+	    startup_ecn_rounds:2,        /* rounds in a row with high CE in STARTUP */
+	    coexist_shallow:3,           /* loss-based flows in a shallow buffer? */
+	    coexist_deep:2,              /* ... or in a deep buffer? */
+	    probe_down_round_done:1;     /* PROBE_DOWN has lasted a round? */
+	u16 coexist_min_rtt;             /* min_rtt of last window, 16 us units */
+	u16 inflight_used;               /* max inflight, halved each round */
+};
+
+/* BBRv3 pacing gains for PROBE_BW, indexed by enum bbr_pacing_gain_phase */
+static const int bbr_pacing_gain[] = {
+	BBR_UNIT * 5 / 4,	/* probe for more available bw */
+	BBR_UNIT * 3 / 4,	/* drain queue and/or yield bw to other flows */
+	BBR_UNIT, BBR_UNIT, BBR_UNIT,	/* cruise at 1.0*bw to utilize pipe, */
+	BBR_UNIT, BBR_UNIT, BBR_UNIT	/* without creating excess queue... */
+};
+
+/* BBRv1 paces STARTUP at 2/ln(2) and uses that as its cwnd gain too. BBRv2/v3
+ * pace at 4*ln(2), which still doubles the sending rate each round with a
+ * cwnd gain of 2, so STARTUP builds about half the queue.
+ */
+static const int bbr_high_gain  = BBR_UNIT * 2885 / 1000 + 1;
+static const int bbr_startup_pacing_gain = BBR_UNIT * 277 / 100 + 1;
+static const int bbr_drain_gain = BBR_UNIT * 1000 / 2885;
+static const int bbr_cwnd_gain  = BBR_UNIT * 2;
+/* BBRv3 raises cwnd_gain while in PROBE_UP, so that cwnd does not cap the
+ * extra inflight the probe needs to see more bw.
+ */
+static const int bbr_bw_probe_cwnd_gain = BBR_UNIT * 9 / 4;
+
+/* BBRv1 randomizes the starting phase of its gain cycle among all but the
+ * 3/4 draining phase, so that flows do not probe in lockstep.
+ */
+static const u32 bbr_cycle_rand = 7;
+
+/* BBRv1 ages its max bw filter by rounds: each slot of bw_hi[] covers this
+ * many rounds, so the filter spans the last 5-10 rounds.
+ */
+static const u32 bbr_v1_bw_filter_rounds = 5;
+
+/* Try to keep at least this many packets in flight, if things go smoothly. For
+ * smooth functioning, a sliding window protocol ACKing every other packet
+ * needs at least 4 packets in flight:
+ */
+static const u32 bbr_cwnd_min_target = 4;
+
+/* While the app or the peer's receive window rather than cwnd limits
+ * inflight, ACKs say nothing about what more the path takes: cwnd does not
+ * grow, and is cut to bbr_limited_cwnd_gain times the inflight actually
+ * used (but no lower than the initial cwnd), so that an app catching up
+ * does not release a cwnd's worth of data the model never tested.
+ */
+static const int bbr_limited_cwnd_gain = BBR_UNIT * 2;
+
+/* In PROBE_RTT, cap inflight at this fraction of the BDP. Shallower than the
+ * bbr_cwnd_min_target dip of BBRv1, so throughput stays up while the queue
+ * drains, and pipe sharing flows still see the path's min RTT.
+ */
+static const int bbr_probe_rtt_cwnd_gain = BBR_UNIT * 1 / 2;
+
+/* An idle period at least as long as a PROBE_RTT hold drains the queue as
+ * well as PROBE_RTT would. With PROBE_RTT disabled (probe_rtt_mode_ms 0)
+ * the idle must still last this long, or any pause would count.
+ */
+static const u32 bbr_idle_drain_ms = 200;
+
+/* Time to wait between bw probes in PROBE_BW: bbr_bw_probe_base_us plus a
+ * random amount up to bbr_bw_probe_rand_us, so that flows sharing a
+ * bottleneck do not synchronize their probes.
+ */
+static const u32 bbr_bw_probe_base_us = 2 * USEC_PER_SEC;
+static const u32 bbr_bw_probe_rand_us = 1 * USEC_PER_SEC;
+
+/* Also probe at least every bbr_bw_probe_max_rounds rounds, or sooner if a
+ * Reno flow with our BDP would, so loss-based flows do not starve us.
+ */
+static const u32 bbr_bw_probe_max_rounds = 63;
+static const u32 bbr_bw_probe_rand_rounds = 2;
+
+/* If bw has increased by at least bbr_full_bw_thresh (25%) in a round, we
+ * estimate the pipe is not yet full. After bbr_full_bw_cnt rounds without
+ * such growth, we estimate the pipe is full and leave STARTUP.
+ */
+static const u32 bbr_full_bw_thresh = BBR_UNIT * 5 / 4;
+static const u32 bbr_full_bw_cnt = 3;
+
+/* BBRv2/v3 also leave STARTUP once its queue overflows the bottleneck: after
+ * a round with at least bbr_full_loss_cnt loss events and a loss rate above
+ * bbr_loss_thresh, or bbr_full_ecn_cnt rounds in a row with a CE mark rate
+ * above bbr_ecn_thresh.
+ */
+static const u32 bbr_full_loss_cnt = 6;
+static const u32 bbr_full_ecn_cnt = 2;
+
+/* Pace at ~1% below estimated bw, on average, to reduce queue at bottleneck */
+static const int bbr_pacing_margin_percent = 1;
+
+/* Below this pacing rate (in bits/sec), send 1-segment TSO bursts; above it,
+ * at least 2, so high-rate flows do not pay per-segment transmit costs.
+ */
+static const int bbr_min_tso_rate = 1200000;
+
+/* Loss/ECN model. Inflight is "too high" when more than bbr_loss_thresh of
+ * the packets in flight are lost within a round, or more than bbr_ecn_thresh
+ * of the packets delivered in a round carry CE marks. When a bw probe goes
+ * too high, inflight_hi is set at the level where that happened.
+ */
+static const u32 bbr_loss_thresh = BBR_UNIT * 2 / 100;
+static const u32 bbr_ecn_thresh = BBR_UNIT * 1 / 2;
+
+/* Multiplicative decrease of bw_lo/inflight_lo after a round with loss */
+static const u32 bbr_beta = BBR_UNIT * 30 / 100;
+
+/* Fraction of inflight_hi left unused while cruising, as headroom for other
+ * flows and to reduce the chance of loss.
+ */
+static const u32 bbr_inflight_headroom = BBR_UNIT * 15 / 100;
+
+/* Coexistence with loss-based flows (Reno, CUBIC), if enabled. They fill
+ * whatever buffer the bottleneck has, and how that goes for us depends on
+ * its depth, so the two cases are told apart and answered separately:
+ *
+ * - In a shallow buffer they lose packets and halve, while we ride out the
+ *   loss rate they cause, and take most of the link. While cruising we pace
+ *   at the estimated bw below inflight_hi, so a round with an RTT sample
+ *   bbr_coexist_rtt_high above min_rtt is a queue someone else built.
+ *   coexist_shallow counts such rounds up and other cruising rounds down,
+ *   and each step of it leaves another bbr_coexist_headroom of inflight_hi
+ *   unused.
+ * - In a deep buffer they keep a queue standing, and we get no more than
+ *   the rate we pace at into it: min_rtt then grows with each window, by
+ *   more than bbr_coexist_rtt_growth. While coexist_deep says so, CRUISE
+ *   paces at bbr_coexist_pacing_gain and lets cwnd, at bbr_coexist_cwnd_gain,
+ *   decide our share, as it does theirs.
+ */
+static const u32 bbr_coexist_rtt_high = BBR_UNIT * 1 / 8;
+static const u32 bbr_coexist_rtt_growth = BBR_UNIT * 1 / 16;
+static const u32 bbr_coexist_headroom = BBR_UNIT * 5 / 100;
+static const int bbr_coexist_pacing_gain = BBR_UNIT * 5 / 4;
+static const int bbr_coexist_cwnd_gain = BBR_UNIT * 11 / 8;
+static const u32 bbr_coexist_shallow_max = 7;
+static const u32 bbr_coexist_deep_max = 3;
+
+/* ECN response: ecn_alpha is a per-round EWMA of the CE-marked fraction with
+ * gain bbr_ecn_alpha_gain, and each round with CE marks cuts inflight_lo by
+ * ecn_alpha * bbr_ecn_factor. CE marks are only used on paths whose min_rtt
+ * is at most bbr_ecn_max_rtt_us, i.e. a heuristic for "inside the DC".
+ * The CE fraction is that of the ACKs with ECE, so it takes receivers that
+ * echo CE per packet rather than until CWR, as bbr3_ecn and dctcp do.
+ */
+static const u32 bbr_ecn_alpha_gain = BBR_UNIT * 1 / 16;
+static const u32 bbr_ecn_alpha_init = BBR_UNIT;
+static const u32 bbr_ecn_factor = BBR_UNIT * 1 / 3;
+static const u32 bbr_ecn_max_rtt_us = 5000;
+
+/* ACK aggregation (Wi-Fi, cellular, LRO/GRO receivers) delivers ACKs in
+ * bursts, with gaps in between that a cwnd of bw * min_rtt cannot cover.
+ * Estimate the excess data ACKed beyond the bw * interval expected, as a max
+ * over the last bbr_extra_acked_win_rtts rounds (in two halves), and add
+ * bbr_extra_acked_gain times that to the cwnd target. The extra cwnd is
+ * bounded by bbr_extra_acked_max_us worth of data at the current bw, and an
+ * epoch that grows past bbr_ack_epoch_acked_reset_thresh packets starts over.
+ */
+static const int bbr_extra_acked_gain = BBR_UNIT;
+static const u32 bbr_extra_acked_win_rtts = 5;
+static const u32 bbr_ack_epoch_acked_reset_thresh = 1U << 20;
+static const u32 bbr_extra_acked_max_us = 100 * 1000;
+
+/* Token-bucket traffic policers are common (see "An Internet-Wide Analysis of
+ * Traffic Policing", SIGCOMM 2016). BBRv1 and BBRv2 detect them by sampling
+ * the delivery rate over long-term ("LT") intervals: if two consecutive
+ * intervals of at least bbr_lt_intvl_min_rtts rounds each see a loss rate of
+ * bbr_lt_loss_thresh or more and delivery rates within bbr_lt_bw_ratio or
+ * bbr_lt_bw_diff of each other, the flow is being policed, and bw is pinned
+ * to the policed rate for bbr_lt_bw_max_rtts rounds. BBRv3 leaves this to its
+ * loss model, which bounds inflight_hi and bw_lo on the same signal.
+ */
+static const u32 bbr_lt_intvl_min_rtts = 4;
+static const u32 bbr_lt_loss_thresh = 50;	/* 50/256 = ~20% loss */
+static const u32 bbr_lt_bw_ratio = BBR_UNIT / 8;
+static const u32 bbr_lt_bw_diff = 4000 / 8;	/* bytes/sec, ie 4 kbit/sec */
+static const u32 bbr_lt_bw_max_rtts = 48;
+
+/* Per-ACK scratch state passed between the model update steps */
+struct bbr3_context {
+	u32 round_delivered; /* on round_start: packets delivered last round */
+	u32 round_lost;      /* on round_start: packets lost last round */
+	u32 round_ce;        /* on round_start: CE marks seen last round */
+};
+
+/* Event counters, and the buckets of the pacing rate histogram of
+ * bbr3_stat_pacing_rate(): bucket 0 is < 1 Mbit/sec, bucket i >= 2^(i-1).
+ */
+enum bbr3_stat_item {
+	BBR3_STAT_INIT,			/* sockets started */
+	BBR3_STAT_STARTUP_EXIT,		/* STARTUP found full bw */
+	BBR3_STAT_PROBE_RTT,		/* PROBE_RTT entries */
+	BBR3_STAT_INFLIGHT_HI_CUT,	/* inflight_hi cut on loss/ECN */
+	BBR3_STAT_POLICER,		/* policers detected (lt_bw) */
+	BBR3_STAT_WARM_START,		/* sockets seeded from the cache */
+	BBR3_STAT_CKPT_RESTORE,		/* sockets resumed from a checkpoint */
+	BBR3_STAT_MAX
+};
+
+#define BBR3_PACING_HIST_BUCKETS	18	/* top bucket: >= 65536 Mbit/sec */
+
+/* Provided by the including file */
+static void bbr3_stat_inc(enum bbr3_stat_item item);
+static void bbr3_stat_pacing_rate(struct sock *sk);
+static enum bbr_version bbr3_sk_version(const struct sock *sk);
+
+/* Units. A bw is a u32 count of packets per usec << BW_SCALE everywhere: in
+ * the max filter, bw_lo, full_bandwidth and every helper below. That covers
+ * up to 256 packets/usec (~3 Tbit/s of 1500 byte packets) with 2^-24
+ * packets/usec resolution. cwnd, inflight and BDP values are in packets,
+ * and gains are fractions scaled by BBR_UNIT. The helpers below are the only
+ * places that convert between these units, and they work in 64-bit (or
+ * 128-bit, via mul_u64_u32_shr()) intermediates, saturating where the result
+ * is stored in a u32.
+ */
+
+/* Return the bw of delivering pkts packets in interval_us */
+static u32 bbr3_bw_from_delivery(u64 pkts, u32 interval_us)
+{
+	u64 bw = pkts * BW_UNIT;
+
+	do_div(bw, interval_us);
+	return min_t(u64, bw, U32_MAX);
+}
+
+/* Return the number of packets delivered at bw in interval_us */
+static u32 bbr3_bw_to_pkts(u32 bw, u32 interval_us)
+{
+	return min_t(u64, ((u64)bw * interval_us) >> BW_SCALE, U32_MAX);
+}
+
+/* Apply a gain (fraction scaled by BBR_UNIT) to a value */
+static u64 bbr3_apply_gain(u64 val, u32 gain)
+{
+	return mul_u64_u32_shr(val, gain, BBR_SCALE);
+}
+
+/* Convert a bw and gain to bytes/sec, less bbr_pacing_margin_percent */
+static u64 bbr3_rate_bytes_per_sec(struct sock *sk, u32 bw, int gain)
+{
+	u64 rate = bbr3_apply_gain((u64)bw * tcp_sk(sk)->mss_cache, gain);
+
+	return mul_u64_u32_shr(rate,
+			       USEC_PER_SEC / 100 * (100 - bbr_pacing_margin_percent),
+			       BW_SCALE);
+}
+
+/* Convert a BBR bw and gain factor to a pacing rate in bytes per second */
+static unsigned long bbr3_bw_to_pacing_rate(struct sock *sk, u32 bw, int gain)
+{
+	u64 rate = bbr3_rate_bytes_per_sec(sk, bw, gain);
+
+	rate = min_t(u64, rate, sk->sk_max_pacing_rate);
+	return rate;
+}
+
+/* Initialize pacing rate to: pacing_gain * init_cwnd / RTT */
+static void bbr3_init_pacing_rate_from_rtt(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 bw, rtt_us;
+
+	if (tp->srtt_us) {		/* any RTT sample yet? */
+		rtt_us = max(tp->srtt_us >> 3, 1U);
+		bbr->has_seen_rtt = 1;
+	} else {			 /* no RTT sample yet */
+		rtt_us = USEC_PER_MSEC;	 /* use nominal default RTT */
+	}
+	bw = bbr3_bw_from_delivery(tp->snd_cwnd, rtt_us);
+	WRITE_ONCE(sk->sk_pacing_rate,
+		   bbr3_bw_to_pacing_rate(sk, bw, bbr->pacing_gain));
+}
+
+/* Pace using current bw estimate and a gain factor. Until the pipe is known
+ * to be full, never lower the pacing rate: a low early bw sample must not
+ * throttle STARTUP below the rate implied by the initial cwnd.
+ */
+static void bbr3_set_pacing_rate(struct sock *sk, u32 bw, int gain)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	unsigned long rate = bbr3_bw_to_pacing_rate(sk, bw, gain);
+
+	if (unlikely(!bbr->has_seen_rtt && tp->srtt_us))
+		bbr3_init_pacing_rate_from_rtt(sk);
+	if (bbr->full_bandwidth_reached || rate > READ_ONCE(sk->sk_pacing_rate))
+		WRITE_ONCE(sk->sk_pacing_rate, rate);
+}
+
+/* Minimum TSO burst size, in segments, for the current pacing rate */
+static u32 bbr3_min_tso_segs(struct sock *sk)
+{
+	return READ_ONCE(sk->sk_pacing_rate) < (bbr_min_tso_rate >> 3) ? 1 : 2;
+}
+
+/* Return the number of segments BBR would like in each TSO burst: about
+ * 1ms of data at the pacing rate, like tcp_tso_autosize(), but ignoring
+ * the driver provided sk_gso_max_size.
+ */
+static u32 bbr3_tso_segs_goal(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	u32 segs, bytes;
+
+	bytes = min_t(unsigned long,
+		      READ_ONCE(sk->sk_pacing_rate) >>
+		      READ_ONCE(sk->sk_pacing_shift),
+		      GSO_LEGACY_MAX_SIZE - 1 - MAX_TCP_HEADER);
+	segs = max_t(u32, bytes / tp->mss_cache, bbr3_min_tso_segs(sk));
+
+	return min(segs, 0x7FU);
+}
+
+/* Save "last known good" cwnd so we can restore it after losses or PROBE_RTT */
+static void bbr3_save_cwnd(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	if (bbr->prev_ca_state < TCP_CA_Recovery && bbr->mode != BBR_PROBE_RTT)
+		bbr->prior_cwnd = tp->snd_cwnd;  /* this cwnd is good enough */
+	else  /* loss recovery or BBR_PROBE_RTT have temporarily cut cwnd */
+		bbr->prior_cwnd = max(bbr->prior_cwnd, tp->snd_cwnd);
+}
+
+/* Start a new long-term sampling interval at the current delivery point */
+static void bbr3_reset_lt_bw_sampling_interval(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	bbr->lt_last_stamp = div_u64(tp->delivered_mstamp, USEC_PER_MSEC);
+	bbr->lt_last_delivered = tp->delivered;
+	bbr->lt_last_lost = tp->lost;
+	bbr->lt_rtt_cnt = 0;
+}
+
+/* Completely reset long-term bandwidth sampling */
+static void bbr3_reset_lt_bw_sampling(struct sock *sk)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	bbr->lt_bw = 0;
+	bbr->lt_use_bw = 0;
+	bbr->lt_is_sampling = 0;
+	bbr3_reset_lt_bw_sampling_interval(sk);
+}
+
+/* Set the STARTUP gains of this version */
+static __always_inline void bbr3_set_startup_gains(struct sock *sk,
+						   const enum bbr_version ver)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	if (ver == BBR_V1) {
+		bbr->pacing_gain = bbr_high_gain;
+		bbr->cwnd_gain = bbr_high_gain;
+	} else {
+		bbr->pacing_gain = bbr_startup_pacing_gain;
+		bbr->cwnd_gain = bbr_cwnd_gain;
+	}
+}
+
+/* Reset the model of a new connection: empty filters, STARTUP. The
+ * tunables, cwnd and pacing rate are left to the caller.
+ */
+static void bbr3_init_state(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	/* Initialize the BBRv3 state variables to default values */
+	memset(bbr, 0, sizeof(*bbr));
+	
+	bbr->min_rtt_us = ~0U;
+	bbr->min_rtt_stamp = tcp_jiffies32;
+	bbr->probe_rtt_done_stamp = 0;
+	bbr->bw_hi[0] = 0;
+	bbr->bw_hi[1] = 0;
+	bbr->rtt_cnt = 0;
+	bbr->next_rtt_delivered = tp->delivered;
+	bbr->inflight_hi = ~0U;
+	bbr->inflight_lo = ~0U;
+	bbr->bw_lo = ~0U;
+	bbr->round_lost_start = tp->lost;
+	bbr->round_ce_start = tp->delivered_ce;
+	bbr->ack_epoch_mstamp = (u32)tp->tcp_mstamp;
+	bbr->ack_epoch_acked = 0;
+	bbr->extra_acked[0] = 0;
+	bbr->extra_acked[1] = 0;
+	bbr->extra_acked_win_rtts = 0;
+	bbr->extra_acked_win_idx = 0;
+	bbr->ecn_alpha = bbr_ecn_alpha_init;
+	bbr->ecn_eligible = 0;
+	bbr->full_bandwidth = 0;
+	bbr->prior_cwnd = 0;
+	bbr->cycle_start = 0;
+	bbr->cycle_idx = 0;
+	bbr->rounds_since_probe = 0;
+	bbr->bw_probe_samples = 0;
+	bbr->prev_probe_too_high = 0;
+	bbr->bw_probe_up_rounds = 0;
+	bbr3_set_startup_gains(sk, bbr3_sk_version(sk));
+	bbr->mode = BBR_STARTUP;
+	bbr->prev_ca_state = TCP_CA_Open;
+	bbr->full_bandwidth_reached = 0;
+	bbr->round_start = 0;
+	bbr->packet_conservation = 0;
+	bbr->probe_rtt_round_done = 0;
+	bbr->has_seen_rtt = 0;
+	bbr->full_bandwidth_count = 0;
+	bbr3_reset_lt_bw_sampling(sk);
+	bbr->ce_state = 0;
+	if (bbr3_sk_version(sk) == BBR_V3)
+		bbr->prior_rcv_nxt = tp->rcv_nxt;
+	bbr3_stat_inc(BBR3_STAT_INIT);
+}
+
+/* Return the windowed max recent bandwidth sample, in pkts/uS << BW_SCALE */
+static u32 bbr3_max_bw(const struct sock *sk)
+{
+	const struct bbr3 *bbr = inet_csk_ca(sk);
+
+	return max(bbr->bw_hi[0], bbr->bw_hi[1]);
+}
+
+/* Age out the older half of the max bw filter. A slot that saw no samples
+ * (e.g. the flow was idle) keeps the previous window rather than forgetting
+ * the estimate entirely.
+ */
+static void bbr3_advance_max_bw_filter(struct sock *sk)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	if (!bbr->bw_hi[1])
+		return;
+	bbr->bw_hi[0] = bbr->bw_hi[1];
+	bbr->bw_hi[1] = 0;
+}
+
+/* Return the bw the model currently allows us to use: the policed rate if
+ * one was detected, else the max filtered bw, bounded by the short-term
+ * bw_lo after recent loss/ECN.
+ */
+static u32 bbr3_bw(const struct sock *sk)
+{
+	const struct bbr3 *bbr = inet_csk_ca(sk);
+
+	if (unlikely(bbr->lt_use_bw))
+		return bbr->lt_bw;
+	return min(bbr3_max_bw(sk), bbr->bw_lo);
+}
+
+/* Switch mode; every mode change goes through here so it can be traced */
+static void bbr3_set_mode(struct sock *sk, u8 mode)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	trace_bbr3_state_change(sk, bbr->mode, bbr->cycle_idx, mode,
+				bbr->cycle_idx, bbr3_bw(sk), bbr->min_rtt_us);
+	bbr->mode = mode;
+}
+
+/* A min_rtt window ends. If the min RTT keeps growing from one window to the
+ * next, loss-based flows are filling a deep buffer.
+ */
+static void bbr3_update_coexist_deep(struct sock *sk)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 deep = bbr->coexist_deep, prev = bbr->coexist_min_rtt;
+	u32 min_rtt = min_t(u32, bbr->min_rtt_us >> 4, U16_MAX);
+
+	if (prev &&
+	    min_rtt > prev + bbr3_apply_gain(prev, bbr_coexist_rtt_growth))
+		deep = min(deep + 1, bbr_coexist_deep_max);
+	else if (deep)
+		deep--;
+	bbr->coexist_deep = deep;
+	bbr->coexist_min_rtt = min_rtt;
+}
+
+/* Update minimum RTT filter */
+static void bbr3_update_min_rtt(struct sock *sk, const struct rate_sample *rs)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	bool filter_expired;
+
+	/* Track min RTT seen in the min_rtt_win_sec filter window: */
+	filter_expired = after(tcp_jiffies32,
+			       bbr->min_rtt_stamp + bbr->min_rtt_win_sec * HZ);
+	if (rs->rtt_us >= 0 &&
+	    (rs->rtt_us < bbr->min_rtt_us ||
+	     ((filter_expired || bbr->idle_drained) && !rs->is_ack_delayed))) {
+		if (filter_expired && bbr->coexist)
+			bbr3_update_coexist_deep(sk);
+		bbr->min_rtt_us = rs->rtt_us;
+		bbr->min_rtt_stamp = tcp_jiffies32;
+		/* After a long idle the queue is gone, so this sample is as
+		 * good as one taken in PROBE_RTT.
+		 */
+		if (bbr->idle_drained)
+			filter_expired = false;
+	}
+	if (rs->rtt_us >= 0)
+		bbr->idle_drained = 0;
+
+	/* An expired filter means the path's min RTT has not been seen for a
+	 * while, most likely because our own queue hides it. Dip inflight to
+	 * drain the queue and measure it again.
+	 */
+	if (bbr->probe_rtt_mode_ms > 0 && filter_expired &&
+	    !bbr->idle_restart && bbr->mode != BBR_PROBE_RTT) {
+		bbr3_set_mode(sk, BBR_PROBE_RTT);
+		bbr->pacing_gain = BBR_UNIT;
+		bbr->cwnd_gain = BBR_UNIT;
+		bbr3_save_cwnd(sk);  /* note cwnd so we can restore it */
+		bbr->probe_rtt_done_stamp = 0;
+		bbr3_stat_inc(BBR3_STAT_PROBE_RTT);
+		trace_bbr3_probe_rtt(sk, BBR3_PROBE_RTT_ENTER, bbr->min_rtt_us,
+				     bbr->prior_cwnd);
+	}
+
+	if (rs->delivered > 0)
+		bbr->idle_restart = 0;
+}
+
+/* Start a new packet-timed round now, snapshotting the delivered, lost and
+ * CE-marked packet counts that per-round loss/ECN rates are measured from.
+ */
+static void bbr3_start_round(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	bbr->next_rtt_delivered = tp->delivered;
+	bbr->round_lost_start = tp->lost;
+	bbr->round_ce_start = tp->delivered_ce;
+}
+
+/* Track packet-timed rounds. A round ends when a packet sent after the
+ * previous round start is delivered. bbr->round_start and bbr->rtt_cnt are
+ * the clock every round-based filter and state transition runs on, so this
+ * runs first on each ACK.
+ */
+static void bbr3_update_round(struct sock *sk, const struct rate_sample *rs,
+			      struct bbr3_context *ctx)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	bbr->round_start = 0;
+	if (rs->interval_us > 0 &&
+	    !before(rs->prior_delivered, bbr->next_rtt_delivered)) {
+		ctx->round_delivered = tp->delivered - bbr->next_rtt_delivered;
+		ctx->round_lost = tp->lost - bbr->round_lost_start;
+		ctx->round_ce = tp->delivered_ce - bbr->round_ce_start;
+		bbr3_start_round(sk);
+		bbr->rtt_cnt++;
+		bbr->round_start = 1;
+		bbr->packet_conservation = 0;
+	}
+}
+
+/* Return the bandwidth of this ACK's rate sample, 0 if it is not a valid
+ * observation. This is a 64-bit division, so the ACK path only computes it
+ * for the samples it keeps; see bbr3_update_bw().
+ */
+static u32 bbr3_sample_bw(const struct rate_sample *rs)
+{
+	if (rs->delivered < 0 || rs->interval_us <= 0)
+		return 0;
+	return bbr3_bw_from_delivery(rs->delivered, rs->interval_us);
+}
+
+/* Is bbr3_sample_bw(rs) > bw? The same test without the division:
+ * delivered / interval > bw if and only if delivered >= (bw + 1) * interval.
+ */
+static bool bbr3_sample_bw_above(const struct rate_sample *rs, u32 bw)
+{
+	if (rs->delivered < 0 || rs->interval_us <= 0)
+		return false;
+	return (u64)rs->delivered * BW_UNIT >=
+	       ((u64)bw + 1) * (u32)rs->interval_us;
+}
+
+/* Did the app or the peer's receive window hold this sample below what the
+ * path would have taken? The stack only marks app-limited samples, but
+ * one sent into a full receive window shows no more than the window allows.
+ */
+static bool bbr3_sample_is_limited(const struct sock *sk,
+				   const struct rate_sample *rs)
+{
+	return rs->is_app_limited || bbr3_is_rwnd_limited(tcp_sk(sk));
+}
+
+/* Estimate the bandwidth based on how fast packets are delivered */
+static void bbr3_update_bw(struct sock *sk, const struct rate_sample *rs)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 thresh = bbr->bw_hi[1];
+
+	/* Incorporate the sample into the current half of the max filter.
+	 * Limited samples only show what the app or the receiver offered, so
+	 * they only count when they reach the estimate anyway: an idle period
+	 * must not drag the filter down. Most samples change nothing, and
+	 * only the ones that do pay for computing the sample.
+	 */
+	if (bbr3_sample_is_limited(sk, rs) && bbr->bw_hi[0] > thresh)
+		thresh = bbr->bw_hi[0] - 1;
+	if (unlikely(bbr3_sample_bw_above(rs, thresh)))
+		bbr->bw_hi[1] = max(bbr3_sample_bw(rs), bbr->bw_hi[1]);
+}
+
+/* Return the max excess data ACKed in the extra_acked window, in packets */
+static u32 bbr3_extra_acked(const struct sock *sk)
+{
+	const struct bbr3 *bbr = inet_csk_ca(sk);
+
+	return max(bbr->extra_acked[0], bbr->extra_acked[1]);
+}
+
+/* Return the cwnd in packets needed to keep sending through ACK aggregation */
+static u32 bbr3_ack_aggregation_cwnd(struct sock *sk)
+{
+	const struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 max_aggr_cwnd, aggr_cwnd = 0;
+
+	if (bbr_extra_acked_gain && bbr->full_bandwidth_reached) {
+		max_aggr_cwnd = bbr3_bw_to_pkts(bbr3_bw(sk),
+						bbr_extra_acked_max_us);
+		aggr_cwnd = bbr3_apply_gain(bbr3_extra_acked(sk),
+					    bbr_extra_acked_gain);
+		aggr_cwnd = min(aggr_cwnd, max_aggr_cwnd);
+	}
+	return aggr_cwnd;
+}
+
+/* Track how much data was ACKed beyond what the estimated bw explains, since
+ * the start of the current ACK sampling epoch. The epoch restarts whenever
+ * ACKs fall back to (or below) the expected rate.
+ */
+static void bbr3_update_ack_aggregation(struct sock *sk,
+					const struct rate_sample *rs)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 epoch_us, expected_acked, extra_acked;
+
+	if (!bbr_extra_acked_gain || rs->acked_sacked <= 0 ||
+	    rs->delivered < 0 || rs->interval_us <= 0)
+		return;
+
+	if (bbr->round_start) {
+		bbr->extra_acked_win_rtts = min(0x1F,
+						bbr->extra_acked_win_rtts + 1);
+		if (bbr->extra_acked_win_rtts >= bbr_extra_acked_win_rtts) {
+			bbr->extra_acked_win_rtts = 0;
+			bbr->extra_acked_win_idx = !bbr->extra_acked_win_idx;
+			bbr->extra_acked[bbr->extra_acked_win_idx] = 0;
+		}
+	}
+
+	/* Packets we expected to be delivered over the epoch */
+	epoch_us = (u32)tp->delivered_mstamp - bbr->ack_epoch_mstamp;
+	expected_acked = bbr3_bw_to_pkts(bbr3_bw(sk), epoch_us);
+
+	/* Reset the epoch if ACKs arrive no faster than expected, or the epoch
+	 * has grown so large that it is likely stale.
+	 */
+	if (bbr->ack_epoch_acked <= expected_acked ||
+	    bbr->ack_epoch_acked + rs->acked_sacked >=
+	    bbr_ack_epoch_acked_reset_thresh) {
+		bbr->ack_epoch_acked = 0;
+		bbr->ack_epoch_mstamp = (u32)tp->delivered_mstamp;
+		expected_acked = 0;
+	}
+
+	/* Excess data delivered beyond what was expected, bounded by cwnd */
+	bbr->ack_epoch_acked = min_t(u32, 0xFFFFF,
+				     bbr->ack_epoch_acked + rs->acked_sacked);
+	extra_acked = bbr->ack_epoch_acked - expected_acked;
+	extra_acked = min3(extra_acked, tp->snd_cwnd, 0xFFFFU);
+	if (extra_acked > bbr->extra_acked[bbr->extra_acked_win_idx])
+		bbr->extra_acked[bbr->extra_acked_win_idx] = extra_acked;
+}
+
+/* Track the inflight the flow actually uses, for bbr_limited_cwnd_gain: the
+ * max inflight seen by ACKs, halved at each round start so that it follows
+ * a falling load within a few rounds but outlasts the tail of a burst.
+ * PROBE_RTT's dip is ours, not the app's, and marks its samples app-limited:
+ * skip it, or the flow would leave PROBE_RTT with cwnd cut to the dip.
+ */
+static void bbr3_update_inflight_used(struct sock *sk,
+				      const struct rate_sample *rs)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	if (bbr->mode == BBR_PROBE_RTT)
+		return;
+	if (bbr->round_start)
+		bbr->inflight_used >>= 1;
+	if (rs->prior_in_flight > bbr->inflight_used)
+		bbr->inflight_used = min_t(u32, rs->prior_in_flight, U16_MAX);
+}
+
+/* Estimate when the pipe is full, using the change in delivery rate: BBR
+ * estimates that STARTUP filled the pipe if the estimated bw hasn't changed by
+ * at least bbr_full_bw_thresh (25%) after bbr_full_bw_cnt (3) rounds that
+ * were neither app- nor rwnd-limited. Why 3 rounds: 1: rwin autotuning grows
+ * the rwin, 2: we fill the higher rwin, 3: we get higher delivery rate
+ * samples.
+ */
+static void bbr3_check_full_bw_reached(struct sock *sk,
+				       const struct rate_sample *rs)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u64 bw_thresh;
+
+	if (bbr->full_bandwidth_reached || !bbr->round_start ||
+	    bbr3_sample_is_limited(sk, rs))
+		return;
+
+	bw_thresh = bbr3_apply_gain(bbr->full_bandwidth, bbr_full_bw_thresh);
+	if (bbr3_max_bw(sk) >= bw_thresh) {
+		bbr->full_bandwidth = bbr3_max_bw(sk);
+		bbr->full_bandwidth_count = 0;
+		return;
+	}
+	++bbr->full_bandwidth_count;
+	bbr->full_bandwidth_reached = bbr->full_bandwidth_count >= bbr_full_bw_cnt;
+}
+
+/* Return the BDP for the given bw and gain, in packets, rounded up */
+static u32 bbr3_bdp(struct sock *sk, u32 bw, int gain)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u64 w;
+
+	/* If we've never had a valid RTT sample, cap cwnd at the initial
+	 * default. This should only happen when the connection is not using TCP
+	 * timestamps and has retransmitted all of the SYN/SYNACK/data packets
+	 * ACKed so far. In this case, an RTO can cut cwnd to 1, in which
+	 * case we need to slow-start up toward something safe: initial cwnd.
+	 */
+	if (unlikely(bbr->min_rtt_us == ~0U))	/* no valid RTT samples yet? */
+		return tcp_init_cwnd(tcp_sk(sk), __sk_dst_get(sk));
+
+	w = bbr3_apply_gain((u64)bw * bbr->min_rtt_us, gain);
+
+	/* Remove the BW_SCALE shift, and round the value up to avoid a
+	 * negative feedback loop.
+	 */
+	w = (w >> BW_SCALE) + !!(w & (BW_UNIT - 1));
+	return min_t(u64, w, U32_MAX);
+}
+
+/* The amount of data we aim to keep in flight when not probing */
+static u32 bbr3_target_inflight(struct sock *sk)
+{
+	u32 bdp = bbr3_bdp(sk, bbr3_max_bw(sk), BBR_UNIT);
+
+	return min(bdp, tcp_sk(sk)->snd_cwnd);
+}
+
+/* BBRv2/v3: leave STARTUP as soon as its queue overflows the bottleneck
+ * buffer, rather than after three more rounds of the same loss or CE marks.
+ * The bw found so far is the best estimate; inflight_hi goes to what the
+ * path delivered in the round, so PROBE_BW does not rebuild that queue.
+ */
+static void bbr3_check_startup_too_high(struct sock *sk,
+					const struct rate_sample *rs,
+					const struct bbr3_context *ctx)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	bool too_high = false;
+
+	if (bbr->full_bandwidth_reached)
+		return;
+	if (rs->losses && bbr->startup_loss_events < 0xf)
+		bbr->startup_loss_events++;
+	if (!bbr->round_start)
+		return;
+
+	if (bbr->startup_loss_events >= bbr_full_loss_cnt &&
+	    ctx->round_lost > bbr3_apply_gain(ctx->round_delivered +
+					      ctx->round_lost, bbr_loss_thresh))
+		too_high = true;
+	bbr->startup_loss_events = 0;
+
+	if (bbr->ecn_eligible &&
+	    ctx->round_ce > bbr3_apply_gain(ctx->round_delivered, bbr_ecn_thresh)) {
+		if (bbr->startup_ecn_rounds < bbr_full_ecn_cnt)
+			bbr->startup_ecn_rounds++;
+		if (bbr->startup_ecn_rounds >= bbr_full_ecn_cnt)
+			too_high = true;
+	} else {
+		bbr->startup_ecn_rounds = 0;
+	}
+
+	if (too_high) {
+		bbr->full_bandwidth_reached = 1;
+		bbr->inflight_hi = max(bbr3_bdp(sk, bbr3_max_bw(sk), BBR_UNIT),
+				       ctx->round_delivered);
+	}
+}
+
+/* Inflight while cruising: inflight_hi minus some headroom, more of it the
+ * more loss-based flows we share a shallow buffer with
+ */
+static u32 bbr3_inflight_with_headroom(const struct sock *sk)
+{
+	const struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 headroom;
+
+	if (bbr->inflight_hi == ~0U)
+		return ~0U;
+
+	headroom = bbr3_apply_gain(bbr->inflight_hi, bbr_inflight_headroom +
+				   bbr->coexist_shallow * bbr_coexist_headroom);
+	headroom = max(headroom, 1U);
+	return max_t(s32, bbr->inflight_hi - headroom, bbr_cwnd_min_target);
+}
+
+/* Forget the short-term lower bounds, e.g. before probing for more bw */
+static void bbr3_reset_lower_bounds(struct sock *sk)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	bbr->bw_lo = ~0U;
+	bbr->inflight_lo = ~0U;
+}
+
+/* Has the given amount of time elapsed since the start of this phase? */
+static bool bbr3_has_elapsed_in_phase(const struct sock *sk, u32 interval_us)
+{
+	const struct tcp_sock *tp = tcp_sk(sk);
+	const struct bbr3 *bbr = inet_csk_ca(sk);
+
+	return (s32)((u32)tp->tcp_mstamp - (bbr->cycle_start + interval_us)) > 0;
+}
+
+/* Gains of the current PROBE_BW phase */
+static void bbr3_set_cycle_gains(struct sock *sk)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	/* Probing above a policed rate only buys more drops */
+	bbr->pacing_gain = bbr->lt_use_bw ? BBR_UNIT :
+			   bbr_pacing_gain[bbr->cycle_idx];
+	bbr->cwnd_gain = bbr_cwnd_gain;
+	/* Be as window-limited as the loss-based flows keeping a queue */
+	if (bbr->cycle_idx == BBR_BW_PROBE_CRUISE && !bbr->lt_use_bw &&
+	    bbr->coexist_deep > bbr_coexist_deep_max / 2) {
+		bbr->pacing_gain = bbr_coexist_pacing_gain;
+		bbr->cwnd_gain = bbr_coexist_cwnd_gain;
+	}
+}
+
+static void bbr3_set_cycle_idx(struct sock *sk, int cycle_idx)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	trace_bbr3_state_change(sk, bbr->mode, bbr->cycle_idx, bbr->mode,
+				cycle_idx, bbr3_bw(sk), bbr->min_rtt_us);
+	bbr->cycle_idx = cycle_idx;
+	bbr3_set_cycle_gains(sk);
+}
+
+/* Start a new PROBE_BW cycle by draining whatever queue the last probe built.
+ * The wall clock wait until the next probe is randomized by backdating
+ * cycle_start, so that bbr3_has_elapsed_in_phase(bbr_bw_probe_base_us +
+ * bbr_bw_probe_rand_us) fires between base and base + rand from now. That
+ * leaves cycle_start no use for timing PROBE_DOWN itself, which counts a
+ * round instead: it starts one here, and a round lasts at least a min_rtt.
+ */
+static void bbr3_start_bw_probe_down(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	bbr->rounds_since_probe = reciprocal_scale(get_random_u32(),
+						   bbr_bw_probe_rand_rounds);
+	bbr->cycle_start = (u32)tp->tcp_mstamp -
+			   reciprocal_scale(get_random_u32(),
+					    bbr_bw_probe_rand_us);
+	bbr->probe_down_round_done = 0;
+	bbr3_start_round(sk);
+	bbr3_set_cycle_idx(sk, BBR_BW_PROBE_DOWN);
+}
+
+/* Cruise at the estimated bw, without probing up for bw or down for RTT,
+ * only reducing inflight in response to loss/ECN.
+ */
+static void bbr3_start_bw_probe_cruise(struct sock *sk)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	if (bbr->inflight_lo != ~0U)
+		bbr->inflight_lo = min(bbr->inflight_lo, bbr->inflight_hi);
+	bbr3_set_cycle_idx(sk, BBR_BW_PROBE_CRUISE);
+}
+
+/* Send at the estimated bw for a round to fill the pipe before probing
+ * beyond it. This is also the natural point to age out the bw samples of
+ * the previous cycle: the filter then spans this probe and the last one.
+ */
+static void bbr3_start_bw_probe_refill(struct sock *sk)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	bbr3_advance_max_bw_filter(sk);
+	bbr3_reset_lower_bounds(sk);
+	bbr->bw_probe_up_rounds = 0;
+	bbr3_start_round(sk);
+	bbr3_set_cycle_idx(sk, BBR_BW_PROBE_REFILL);
+}
+
+/* Probe for bw with a pacing_gain > 1.0. From here until a round after the
+ * probe ends, loss/ECN signals are attributed to the probe.
+ */
+static __always_inline void bbr3_start_bw_probe_up(struct sock *sk,
+						   const enum bbr_version ver)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	bbr->bw_probe_samples = 1;
+	bbr->cycle_start = (u32)tp->tcp_mstamp;
+	bbr3_start_round(sk);
+	bbr3_set_cycle_idx(sk, BBR_BW_PROBE_UP);
+	if (ver == BBR_V3)
+		bbr->cwnd_gain = bbr_bw_probe_cwnd_gain;
+}
+
+/* Time to probe for bw, either by the randomized wall clock wait or by the
+ * number of rounds a Reno flow at our BDP would take to probe.
+ */
+static bool bbr3_check_time_to_probe_bw(struct sock *sk)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 rounds;
+
+	rounds = min(bbr_bw_probe_max_rounds, bbr3_target_inflight(sk));
+	if (bbr3_has_elapsed_in_phase(sk, bbr_bw_probe_base_us +
+					  bbr_bw_probe_rand_us) ||
+	    bbr->rounds_since_probe >= rounds) {
+		bbr3_start_bw_probe_refill(sk);
+		return true;
+	}
+	return false;
+}
+
+/* BBRv1: move on to the next phase of the 8-phase gain cycle */
+static void bbr3_v1_advance_cycle_phase(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	bbr->cycle_start = (u32)tp->tcp_mstamp;
+	bbr3_set_cycle_idx(sk, (bbr->cycle_idx + 1) & (CYCLE_LEN - 1));
+}
+
+/* BBRv1: each phase lasts about a min_rtt. Probing at 5/4 continues until
+ * inflight reaches 5/4 * BDP or there is loss, and the 3/4 phase ends early
+ * once the queue it drains is gone.
+ */
+static void bbr3_v1_update_cycle_phase(struct sock *sk,
+				       const struct rate_sample *rs)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	bool is_full_length = bbr3_has_elapsed_in_phase(sk, bbr->min_rtt_us);
+	u32 inflight = rs->prior_in_flight;
+	u32 bw = bbr3_max_bw(sk);
+	bool next;
+
+	if (bbr->pacing_gain > BBR_UNIT)
+		next = is_full_length &&
+		       (rs->losses ||
+			inflight >= bbr3_bdp(sk, bw, bbr->pacing_gain));
+	else if (bbr->pacing_gain < BBR_UNIT)
+		next = is_full_length ||
+		       inflight <= bbr3_bdp(sk, bw, BBR_UNIT);
+	else
+		next = is_full_length;
+
+	if (next)
+		bbr3_v1_advance_cycle_phase(sk);
+}
+
+/* Enter PROBE_BW. BBRv1 joins its gain cycle at a random phase; BBRv2/v3
+ * start a new cycle by draining.
+ */
+static __always_inline void bbr3_enter_probe_bw(struct sock *sk,
+						const enum bbr_version ver)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	bbr3_set_mode(sk, BBR_PROBE_BW);
+	if (ver == BBR_V1) {
+		bbr->cycle_idx = CYCLE_LEN - 1 -
+				 reciprocal_scale(get_random_u32(),
+						  bbr_cycle_rand);
+		bbr3_v1_advance_cycle_phase(sk);
+	} else {
+		bbr3_start_bw_probe_down(sk);
+	}
+}
+
+/* Advance the PROBE_BW phase: DOWN -> CRUISE -> REFILL -> UP -> DOWN ... */
+static __always_inline void bbr3_update_cycle_phase(struct sock *sk,
+						    const struct rate_sample *rs,
+						    const enum bbr_version ver)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 inflight = rs->prior_in_flight;
+	u32 bw = bbr3_max_bw(sk);
+
+	if (ver == BBR_V1) {
+		bbr3_v1_update_cycle_phase(sk, rs);
+		return;
+	}
+
+	if (bbr->round_start && bbr->rounds_since_probe < bbr_bw_probe_max_rounds)
+		bbr->rounds_since_probe++;
+	/* A round after the probe stopped, its feedback has all arrived */
+	if (bbr->round_start && (bbr->cycle_idx == BBR_BW_PROBE_DOWN ||
+				 bbr->cycle_idx == BBR_BW_PROBE_CRUISE))
+		bbr->bw_probe_samples = 0;
+
+	switch (bbr->cycle_idx) {
+	case BBR_BW_PROBE_CRUISE:
+		bbr3_check_time_to_probe_bw(sk);
+		break;
+	case BBR_BW_PROBE_REFILL:
+		/* After a round of refilling, samples reflect a full pipe */
+		if (bbr->round_start)
+			bbr3_start_bw_probe_up(sk, ver);
+		break;
+	case BBR_BW_PROBE_UP:
+		/* Probe for at least a min_rtt, until inflight reaches the
+		 * probing target. If the last probe went too high, stop as soon
+		 * as inflight reaches the inflight_hi it set, since the most
+		 * recently sent packets are then likely to cause loss again.
+		 * Probes that do cause too much loss/ECN end in
+		 * bbr3_handle_inflight_too_high().
+		 */
+		if ((bbr->fast_convergence && bbr->prev_probe_too_high &&
+		     inflight >= bbr->inflight_hi) ||
+		    (bbr3_has_elapsed_in_phase(sk, bbr->min_rtt_us) &&
+		     inflight >= bbr3_bdp(sk, bw, bbr->pacing_gain))) {
+			bbr->prev_probe_too_high = 0;  /* no loss/ECN (yet) */
+			bbr3_start_bw_probe_down(sk);
+		}
+		break;
+	case BBR_BW_PROBE_DOWN:
+		/* Drain until inflight is below inflight_hi with headroom, and
+		 * back down to the estimated BDP or, without drain_to_target,
+		 * for at least a round. The BDP test leaves out what this ACK
+		 * delivered: a receiver that ACKs every N packets keeps inflight
+		 * before its ACKs near BDP + N however empty the queue is.
+		 */
+		if (bbr->round_start)
+			bbr->probe_down_round_done = 1;
+		if (bbr3_check_time_to_probe_bw(sk))
+			break;
+		if (inflight <= bbr3_inflight_with_headroom(sk) &&
+		    (inflight - min(inflight, rs->acked_sacked) <=
+		     bbr3_bdp(sk, bw, BBR_UNIT) ||
+		     (!bbr->drain_to_target && bbr->probe_down_round_done)))
+			bbr3_start_bw_probe_cruise(sk);
+		break;
+	}
+}
+
+/* A lossy long-term interval ended with delivery rate bw. If it matches the
+ * previous interval's rate, assume a policer and use the average of the two.
+ */
+static void bbr3_lt_bw_interval_done(struct sock *sk, u32 bw)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 diff;
+
+	if (bbr->lt_bw) {
+		diff = bw > bbr->lt_bw ? bw - bbr->lt_bw : bbr->lt_bw - bw;
+		if ((u64)diff * BBR_UNIT <= (u64)bbr_lt_bw_ratio * bbr->lt_bw ||
+		    bbr3_rate_bytes_per_sec(sk, diff, BBR_UNIT) <=
+		    bbr_lt_bw_diff) {
+			bbr->lt_bw = (bw >> 1) + (bbr->lt_bw >> 1);
+			bbr->lt_use_bw = 1;
+			bbr->pacing_gain = BBR_UNIT;	/* try to avoid drops */
+			bbr->lt_rtt_cnt = 0;
+			bbr3_stat_inc(BBR3_STAT_POLICER);
+			return;
+		}
+	}
+	bbr->lt_bw = bw;
+	bbr3_reset_lt_bw_sampling_interval(sk);
+}
+
+/* Look for token-bucket policing: intervals that are lossy and deliver at a
+ * near-constant rate. Sampling starts at the first loss, is abandoned if the
+ * flow turns app-limited or if an interval runs too long without enough
+ * loss, and an interval ends at a loss once it spans bbr_lt_intvl_min_rtts.
+ */
+static __always_inline void bbr3_lt_bw_sampling(struct sock *sk,
+						const struct rate_sample *rs,
+						const enum bbr_version ver)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 lost, delivered;
+	u32 t;
+
+	if (bbr->lt_use_bw) {
+		/* Policers come and go; periodically re-probe the path */
+		if (bbr->mode == BBR_PROBE_BW && bbr->round_start &&
+		    ++bbr->lt_rtt_cnt >= bbr_lt_bw_max_rtts) {
+			bbr3_reset_lt_bw_sampling(sk);
+			bbr3_enter_probe_bw(sk, ver);
+		}
+		return;
+	}
+
+	if (!bbr->lt_is_sampling) {
+		if (!rs->losses)
+			return;
+		bbr3_reset_lt_bw_sampling_interval(sk);
+		bbr->lt_is_sampling = 1;
+	}
+
+	/* To avoid underestimates, reset sampling if we run out of data */
+	if (rs->is_app_limited) {
+		bbr3_reset_lt_bw_sampling(sk);
+		return;
+	}
+
+	if (bbr->round_start)
+		bbr->lt_rtt_cnt++;
+	if (bbr->lt_rtt_cnt < bbr_lt_intvl_min_rtts)
+		return;
+	if (bbr->lt_rtt_cnt > 4 * bbr_lt_intvl_min_rtts) {
+		bbr3_reset_lt_bw_sampling(sk);	/* interval is too long */
+		return;
+	}
+
+	/* End the interval at a loss, when the policer's tokens are
+	 * presumably exhausted; this also keeps the token refill that follows
+	 * a burst of drops out of the sample.
+	 */
+	if (!rs->losses)
+		return;
+
+	lost = tp->lost - bbr->lt_last_lost;
+	delivered = tp->delivered - bbr->lt_last_delivered;
+	if (!delivered || ((u64)lost << BBR_SCALE) <
+			  (u64)bbr_lt_loss_thresh * delivered)
+		return;
+
+	t = div_u64(tp->delivered_mstamp, USEC_PER_MSEC) - bbr->lt_last_stamp;
+	if ((s32)t < 1)
+		return;		/* interval is less than one ms, so wait */
+	if (t >= ~0U / USEC_PER_MSEC) {
+		bbr3_reset_lt_bw_sampling(sk);	/* interval too long */
+		return;
+	}
+	bbr3_lt_bw_interval_done(sk, bbr3_bw_from_delivery(delivered,
+							   t * USEC_PER_MSEC));
+}
+
+/* Does the loss/ECN rate of the current round say inflight is too high? */
+static bool bbr3_is_inflight_too_high(const struct sock *sk,
+				      const struct rate_sample *rs)
+{
+	const struct tcp_sock *tp = tcp_sk(sk);
+	const struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 lost, ce, delivered;
+
+	lost = tp->lost - bbr->round_lost_start;
+	if (lost &&
+	    lost > bbr3_apply_gain(rs->prior_in_flight, bbr_loss_thresh))
+		return true;
+
+	if (bbr->ecn_eligible) {
+		ce = tp->delivered_ce - bbr->round_ce_start;
+		delivered = tp->delivered - bbr->next_rtt_delivered;
+		if (ce && ce > bbr3_apply_gain(delivered, bbr_ecn_thresh))
+			return true;
+	}
+	return false;
+}
+
+/* A bw probe overfilled the bottleneck buffer: set inflight_hi at the level
+ * where that happened, leaving headroom for other flows, and stop probing.
+ */
+static void bbr3_handle_inflight_too_high(struct sock *sk,
+					  const struct rate_sample *rs)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	bbr->prev_probe_too_high = 1;
+	bbr->bw_probe_samples = 0;  /* only react once per probe */
+	/* App-limited samples do not robustly probe the max safe volume */
+	if (!rs->is_app_limited) {
+		bbr->inflight_hi =
+			max_t(u32, rs->prior_in_flight,
+			      bbr3_apply_gain(bbr3_target_inflight(sk),
+					      BBR_UNIT - bbr_beta));
+		bbr3_stat_inc(BBR3_STAT_INFLIGHT_HI_CUT);
+	}
+	if (bbr->mode == BBR_PROBE_BW && bbr->cycle_idx == BBR_BW_PROBE_UP)
+		bbr3_start_bw_probe_down(sk);
+}
+
+/* In PROBE_UP without loss/ECN: if inflight_hi is what limits us, raise it
+ * by 1, 2, 4, ... packets in successive rounds. cwnd still only grows by the
+ * packets ACKed, so each step is spread over the round that follows.
+ */
+static void bbr3_probe_inflight_hi_upward(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	if (!bbr->round_start || !bbr3_is_cwnd_limited(tp) ||
+	    tp->snd_cwnd < bbr->inflight_hi)
+		return;  /* not fully using inflight_hi, so don't grow it */
+
+	bbr->inflight_hi += 1U << bbr->bw_probe_up_rounds;
+	bbr->bw_probe_up_rounds = min(bbr->bw_probe_up_rounds + 1, 30);
+}
+
+/* Adjust inflight_hi to the loss/ECN signals of this ACK */
+static void bbr3_adapt_upper_bounds(struct sock *sk,
+				    const struct rate_sample *rs)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	if (bbr3_is_inflight_too_high(sk, rs)) {
+		if (bbr->bw_probe_samples)  /* sample is from bw probing? */
+			bbr3_handle_inflight_too_high(sk, rs);
+		return;
+	}
+
+	if (bbr->inflight_hi == ~0U)
+		return;  /* no excess queue signals yet */
+	if (bbr->mode == BBR_DRAIN)
+		return;  /* inflight is still the STARTUP queue */
+
+	/* To be resilient to random loss, raise inflight_hi whenever we see
+	 * that a higher level was safe.
+	 */
+	if (rs->prior_in_flight > bbr->inflight_hi)
+		bbr->inflight_hi = rs->prior_in_flight;
+
+	if (bbr->mode == BBR_PROBE_BW && bbr->cycle_idx == BBR_BW_PROBE_UP)
+		bbr3_probe_inflight_hi_upward(sk);
+}
+
+/* Are we currently pushing inflight up to probe for bw? */
+static bool bbr3_is_probing_bandwidth(const struct sock *sk)
+{
+	const struct bbr3 *bbr = inet_csk_ca(sk);
+
+	return bbr->mode == BBR_STARTUP ||
+	       (bbr->mode == BBR_PROBE_BW &&
+		(bbr->cycle_idx == BBR_BW_PROBE_REFILL ||
+		 bbr->cycle_idx == BBR_BW_PROBE_UP));
+}
+
+/* Track the max bw sampled in this round, the floor of a loss cut of bw_lo.
+ * A round's ACKs sample different stretches of it, and the one that starts
+ * the next round may have seen mostly the loss. Only samples above the max
+ * so far pay for the division. STARTUP keeps full_bandwidth in this space.
+ */
+static void bbr3_update_latest_bw(struct sock *sk, const struct rate_sample *rs)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	if (bbr->mode == BBR_STARTUP)
+		return;
+	if (bbr->round_start)
+		bbr->bw_latest = 0;
+	if (bbr3_sample_bw_above(rs, bbr->bw_latest))
+		bbr->bw_latest = bbr3_sample_bw(rs);
+}
+
+/* After a round with loss or CE marks, cut the short-term bounds bw_lo and
+ * inflight_lo. Loss cuts both by bbr_beta, but not below what the last round
+ * actually delivered: its max bw sample, and the packets it delivered. CE
+ * marks cut inflight_lo in proportion to ecn_alpha.
+ */
+static void bbr3_adapt_lower_bounds(struct sock *sk,
+				    const struct bbr3_context *ctx)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 bw_lo = bbr->bw_lo, inflight_lo = bbr->inflight_lo;
+	u32 loss_inflight_lo, ecn_inflight_lo, ecn_cut;
+
+	if (bw_lo == ~0U)
+		bw_lo = bbr3_max_bw(sk);
+	if (inflight_lo == ~0U)
+		inflight_lo = tp->snd_cwnd;
+	loss_inflight_lo = inflight_lo;
+	ecn_inflight_lo = inflight_lo;
+
+	if (ctx->round_lost) {
+		bw_lo = max_t(u32, bbr->bw_latest,
+			      bbr3_apply_gain(bw_lo, BBR_UNIT - bbr_beta));
+		loss_inflight_lo =
+			max_t(u32, ctx->round_delivered,
+			      bbr3_apply_gain(inflight_lo, BBR_UNIT - bbr_beta));
+	}
+	if (ctx->round_ce && bbr->ecn_eligible) {
+		ecn_cut = BBR_UNIT - ((bbr->ecn_alpha * bbr_ecn_factor) >> BBR_SCALE);
+		ecn_inflight_lo = bbr3_apply_gain(inflight_lo, ecn_cut);
+	}
+
+	bbr->bw_lo = max(bw_lo, 1U);
+	bbr->inflight_lo = min(loss_inflight_lo, ecn_inflight_lo);
+}
+
+/* At the end of each round, update ecn_alpha from the CE-marked fraction of
+ * the round, and react to any loss or CE marks it saw.
+ */
+static void bbr3_update_congestion_signals(struct sock *sk,
+					   const struct rate_sample *rs,
+					   const struct bbr3_context *ctx)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u64 ce_ratio;
+	u32 alpha;
+
+	if (bbr->min_rtt_us > bbr_ecn_max_rtt_us)
+		bbr->ecn_eligible = 0;
+	else if (ctx->round_ce)
+		bbr->ecn_eligible = 1;
+
+	if (bbr->ecn_eligible && ctx->round_delivered) {
+		ce_ratio = (u64)min(ctx->round_ce, ctx->round_delivered) << BBR_SCALE;
+		do_div(ce_ratio, ctx->round_delivered);
+		alpha = ((BBR_UNIT - bbr_ecn_alpha_gain) * bbr->ecn_alpha +
+			 bbr_ecn_alpha_gain * (u32)ce_ratio) >> BBR_SCALE;
+		bbr->ecn_alpha = min_t(u32, alpha, BBR_UNIT);
+	}
+
+	/* We only use lower bounds when not probing; probing must be able to
+	 * push inflight higher.
+	 */
+	if (bbr3_is_probing_bandwidth(sk))
+		return;
+	if (ctx->round_lost || (ctx->round_ce && bbr->ecn_eligible))
+		bbr3_adapt_lower_bounds(sk, ctx);
+}
+
+/* Look for loss-based flows in a shallow buffer at the end of each round
+ * spent cruising, and note whether this round's RTT samples show a queue.
+ */
+static void bbr3_update_coexist(struct sock *sk, const struct rate_sample *rs)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	if (bbr->round_start) {
+		if (bbr->mode == BBR_PROBE_BW &&
+		    bbr->cycle_idx == BBR_BW_PROBE_CRUISE) {
+			if (bbr->coexist_rtt_high)
+				bbr->coexist_shallow =
+					min(bbr->coexist_shallow + 1,
+					    bbr_coexist_shallow_max);
+			else if (bbr->coexist_shallow)
+				bbr->coexist_shallow--;
+			bbr3_set_cycle_gains(sk);  /* for a new coexist_deep */
+		}
+		bbr->coexist_rtt_high = 0;
+	}
+	if (rs->rtt_us < 0 || rs->is_ack_delayed || bbr->min_rtt_us == ~0U)
+		return;
+	if (rs->rtt_us >= bbr->min_rtt_us +
+			  bbr3_apply_gain(bbr->min_rtt_us, bbr_coexist_rtt_high))
+		bbr->coexist_rtt_high = 1;
+}
+
+/* Cap cwnd at the inflight allowed by the loss/ECN model: probe up to
+ * inflight_hi, cruise with headroom below it, and stay within inflight_lo
+ * after recent loss/ECN.
+ */
+static u32 bbr3_inflight_cap(const struct sock *sk)
+{
+	const struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 cap = ~0U;
+
+	if (bbr->mode == BBR_PROBE_BW &&
+	    bbr->cycle_idx != BBR_BW_PROBE_CRUISE)
+		cap = bbr->inflight_hi;  /* probe safely */
+	else if (bbr->mode == BBR_PROBE_RTT || bbr->mode == BBR_PROBE_BW)
+		cap = bbr3_inflight_with_headroom(sk);
+
+	cap = min(cap, bbr->inflight_lo);
+	return max(cap, bbr_cwnd_min_target);
+}
+
+/* Cap on inflight while in PROBE_RTT. BBRv1 dips all the way down to
+ * bbr_cwnd_min_target.
+ */
+static __always_inline u32 bbr3_probe_rtt_cwnd(struct sock *sk,
+					       const enum bbr_version ver)
+{
+	if (ver == BBR_V1)
+		return bbr_cwnd_min_target;
+	return max(bbr3_bdp(sk, bbr3_max_bw(sk), bbr_probe_rtt_cwnd_gain),
+		   bbr_cwnd_min_target);
+}
+
+/* Leave PROBE_RTT: restore the cwnd from before the dip, and resume where
+ * the model left off.
+ */
+static __always_inline void bbr3_exit_probe_rtt(struct sock *sk,
+						const enum bbr_version ver)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	bbr->min_rtt_stamp = tcp_jiffies32;  /* wait a while until PROBE_RTT */
+	tp->snd_cwnd = max(tp->snd_cwnd, bbr->prior_cwnd);
+	trace_bbr3_probe_rtt(sk, BBR3_PROBE_RTT_EXIT, bbr->min_rtt_us,
+			     bbr->prior_cwnd);
+	bbr3_reset_lower_bounds(sk);
+	if (bbr->full_bandwidth_reached) {
+		bbr3_enter_probe_bw(sk, ver);
+		if (ver != BBR_V1)
+			bbr3_start_bw_probe_cruise(sk);
+	} else {
+		bbr3_set_mode(sk, BBR_STARTUP);
+		bbr3_set_startup_gains(sk, ver);
+	}
+}
+
+/* Hold inflight at bbr3_probe_rtt_cwnd() for at least probe_rtt_mode_ms and
+ * one round, then leave PROBE_RTT.
+ */
+static __always_inline void bbr3_update_probe_rtt(struct sock *sk,
+						  const struct rate_sample *rs,
+						  const enum bbr_version ver)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	/* Ignore low rate samples during this mode. */
+	tp->app_limited = (tp->delivered + tcp_packets_in_flight(tp)) ? : 1;
+
+	if (!bbr->probe_rtt_done_stamp &&
+	    tcp_packets_in_flight(tp) <= bbr3_probe_rtt_cwnd(sk, ver)) {
+		bbr->probe_rtt_done_stamp = tcp_jiffies32 +
+			msecs_to_jiffies(bbr->probe_rtt_mode_ms);
+		bbr->probe_rtt_round_done = 0;
+		bbr3_start_round(sk);
+		trace_bbr3_probe_rtt(sk, BBR3_PROBE_RTT_HOLD, bbr->min_rtt_us,
+				     bbr->prior_cwnd);
+	} else if (bbr->probe_rtt_done_stamp) {
+		if (bbr->round_start)
+			bbr->probe_rtt_round_done = 1;
+		if (bbr->probe_rtt_round_done &&
+		    after(tcp_jiffies32, bbr->probe_rtt_done_stamp))
+			bbr3_exit_probe_rtt(sk, ver);
+	}
+}
+
+/* Add headroom to a cwnd target for the way end hosts actually send */
+static u32 bbr3_quantization_budget(struct sock *sk, u32 cwnd)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	/* Allow enough full-sized TSO bursts in flight to utilize end systems */
+	cwnd += 3 * bbr3_tso_segs_goal(sk);
+
+	/* Reduce delayed ACKs by rounding up cwnd to the next even number */
+	cwnd = (cwnd + 1) & ~1U;
+
+	/* Ensure gain cycling gets inflight above BDP even for small BDPs */
+	if (bbr->mode == BBR_PROBE_BW && bbr->cycle_idx == BBR_BW_PROBE_UP)
+		cwnd += 2;
+
+	return cwnd;
+}
+
+/* Leave STARTUP once the pipe is full, then DRAIN until inflight is down to
+ * the estimated BDP, i.e. the queue STARTUP built is gone. cwnd keeps its
+ * STARTUP gain, so only the pacing rate drains.
+ */
+static __always_inline void bbr3_check_drain(struct sock *sk,
+					     const enum bbr_version ver)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	if (bbr->mode == BBR_STARTUP && bbr->full_bandwidth_reached) {
+		bbr3_set_mode(sk, BBR_DRAIN);
+		bbr->bw_latest = 0;	/* was full_bandwidth */
+		bbr3_stat_inc(BBR3_STAT_STARTUP_EXIT);
+		bbr->pacing_gain = bbr_drain_gain;
+	}
+	if (bbr->mode == BBR_DRAIN &&
+	    tcp_packets_in_flight(tcp_sk(sk)) <=
+	    bbr3_quantization_budget(sk, bbr3_bdp(sk, bbr3_max_bw(sk),
+						  BBR_UNIT)))
+		bbr3_enter_probe_bw(sk, ver);
+}
+
+/* BBRv3 state machine */
+static __always_inline void bbr3_update_model(struct sock *sk,
+					      const struct rate_sample *rs,
+					      struct bbr3_context *ctx,
+					      const enum bbr_version ver)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	
+	bbr3_update_round(sk, rs, ctx);
+	if (ver != BBR_V3)
+		bbr3_lt_bw_sampling(sk, rs, ver);
+	if (ver != BBR_V1) {
+		if (bbr->round_start)
+			bbr3_update_congestion_signals(sk, rs, ctx);
+		bbr3_update_latest_bw(sk, rs);
+		if (bbr->coexist)
+			bbr3_update_coexist(sk, rs);
+	} else if (bbr->round_start &&
+		   !(bbr->rtt_cnt % bbr_v1_bw_filter_rounds)) {
+		bbr3_advance_max_bw_filter(sk);
+	}
+	bbr3_update_bw(sk, rs);
+	if (trace_bbr3_bw_sample_enabled())
+		trace_bbr3_bw_sample(sk, rs, bbr3_sample_bw(rs),
+				     bbr3_max_bw(sk), bbr->bw_lo, bbr->rtt_cnt);
+	bbr3_update_ack_aggregation(sk, rs);
+	bbr3_update_inflight_used(sk, rs);
+	bbr3_check_full_bw_reached(sk, rs);
+	bbr3_update_min_rtt(sk, rs);
+	if (ver != BBR_V1 && bbr->full_bandwidth_reached)
+		bbr3_adapt_upper_bounds(sk, rs);
+	if (ver != BBR_V1)
+		bbr3_check_startup_too_high(sk, rs, ctx);
+
+	/* Advance the mode, or the PROBE_BW phase, on what the ACK taught */
+	switch (bbr->mode) {
+	case BBR_STARTUP:
+	case BBR_DRAIN:
+		bbr3_check_drain(sk, ver);
+		break;
+	case BBR_PROBE_BW:
+		bbr3_update_cycle_phase(sk, rs, ver);
+		break;
+	case BBR_PROBE_RTT:
+		bbr3_update_probe_rtt(sk, rs, ver);
+		break;
+	}
+}
+
+/* Loss recovery. An ACK for P packets should release at most 2*P packets:
+ * deduct the packets it marked lost here, and let bbr3_set_cwnd() grow by
+ * the packets it ACKed. The first round of fast recovery uses packet
+ * conservation, sending one packet per packet delivered, so a burst of loss
+ * is not met with a burst of retransmits. An RTO drops to what is in flight
+ * and grows from there. On leaving either state, restore the cwnd saved in
+ * bbr3_ssthresh(). Returns true while packet conservation sets cwnd.
+ */
+static bool bbr3_set_cwnd_to_recover_or_restore(struct sock *sk,
+						const struct rate_sample *rs,
+						u32 acked, u32 *new_cwnd)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u8 prev_state = bbr->prev_ca_state, state = bbr3_ca_state(sk);
+	u32 cwnd = tp->snd_cwnd;
+
+	if (rs->losses > 0)
+		cwnd = max_t(s32, cwnd - rs->losses, 1);
+
+	if (state == TCP_CA_Recovery && prev_state != TCP_CA_Recovery) {
+		/* Start a round now, and cut cwnd left unused by the app, TSQ
+		 * or TSO deferral.
+		 */
+		bbr->packet_conservation = 1;
+		bbr->next_rtt_delivered = tp->delivered;
+		cwnd = tcp_packets_in_flight(tp) + acked;
+	} else if (state == TCP_CA_Loss && prev_state != TCP_CA_Loss) {
+		bbr->packet_conservation = 0;
+		cwnd = tcp_packets_in_flight(tp) + acked;
+	} else if (prev_state >= TCP_CA_Recovery && state < TCP_CA_Recovery) {
+		bbr->packet_conservation = 0;
+		cwnd = max(cwnd, bbr->prior_cwnd);
+	}
+	bbr->prev_ca_state = state;
+
+	if (bbr->packet_conservation) {
+		*new_cwnd = max(cwnd, tcp_packets_in_flight(tp) + acked);
+		return true;
+	}
+	*new_cwnd = cwnd;
+	return false;
+}
+
+/* Update congestion window */
+static __always_inline void bbr3_set_cwnd(struct sock *sk,
+					  const struct rate_sample *rs,
+					  u32 acked, u32 bw, int gain,
+					  const enum bbr_version ver)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 prior_cwnd = tp->snd_cwnd, cwnd = prior_cwnd, target_cwnd = 0;
+
+	if (!acked)
+		goto done;
+
+	if (bbr3_set_cwnd_to_recover_or_restore(sk, rs, acked, &cwnd))
+		goto done;
+
+	/* Calculate target cwnd based on BDP. This is redone on every ACK:
+	 * caching the BDP and the TSO goal until bw, min_rtt, gain or the
+	 * pacing rate changes was within run-to-run noise in bbr3_replay, and
+	 * the cache keys do not fit in icsk_ca_priv.
+	 */
+	if (bbr->min_rtt_us < ~0U && bw) {
+		target_cwnd = bbr3_bdp(sk, bw, gain);
+		target_cwnd += bbr3_ack_aggregation_cwnd(sk);
+		target_cwnd = bbr3_quantization_budget(sk, target_cwnd);
+	}
+
+	/* Grow cwnd by the packets ACKed, up to target_cwnd. Until the pipe is
+	 * full, never cut it to a target built on early, low bw samples.
+	 */
+	if (!target_cwnd)
+		cwnd = cwnd + acked;
+	else if (bbr->full_bandwidth_reached)
+		cwnd = min(target_cwnd, cwnd + acked);
+	else if (cwnd < target_cwnd || tp->delivered < TCP_INIT_CWND)
+		cwnd = cwnd + acked;
+
+	/* Limited by the app or rwnd: hold, and shrink to what is used */
+	if (bbr3_sample_is_limited(sk, rs) && !bbr3_is_cwnd_limited(tp))
+		cwnd = min3(cwnd, prior_cwnd,
+			    max_t(u32, TCP_INIT_CWND,
+				  bbr3_apply_gain(bbr->inflight_used,
+						  bbr_limited_cwnd_gain)));
+
+	cwnd = max(cwnd, bbr_cwnd_min_target);
+	cwnd = min(cwnd, bbr3_inflight_cap(sk));
+
+done:
+	if (bbr->mode == BBR_PROBE_RTT)  /* drain queue, refresh min_rtt */
+		cwnd = min(cwnd, bbr3_probe_rtt_cwnd(sk, ver));
+	tp->snd_cwnd = min(cwnd, tp->snd_cwnd_clamp);
+	trace_bbr3_cwnd_set(sk, bbr->mode, bw, gain, target_cwnd, prior_cwnd);
+}
+
+/* Main BBRv3 algorithm, specialized for each version */
+static __always_inline void __bbr3_main(struct sock *sk,
+					const struct rate_sample *rs,
+					const enum bbr_version ver)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	struct bbr3_context ctx = { 0 };
+	u32 bw;
+
+	trace_bbr3_ack(sk, rs);
+	bbr3_update_model(sk, rs, &ctx, ver);
+
+	bw = bbr3_bw(sk);
+	bbr3_set_pacing_rate(sk, bw, bbr->pacing_gain);
+	bbr3_set_cwnd(sk, rs, rs->acked_sacked, bw, bbr->cwnd_gain, ver);
+	if (bbr->round_start)
+		bbr3_stat_pacing_rate(sk);
+}
+
+/* Implementation of required TCP congestion control operations */
+/* Called on entering fast recovery or RTO: note the cwnd to restore on exit */
+static u32 bbr3_ssthresh(struct sock *sk)
+{
+	bbr3_save_cwnd(sk);
+	return tcp_sk(sk)->snd_ssthresh;
+}
+
+/* The losses were spurious: forget what they taught the model, i.e. the
+ * bw plateau count, long-term sampling and the short-term lower bounds, and
+ * go back to the cwnd from before recovery.
+ */
+static u32 bbr3_undo_cwnd(struct sock *sk)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+
+	bbr->full_bandwidth = 0;
+	bbr->full_bandwidth_count = 0;
+	if (bbr3_sk_version(sk) != BBR_V3)	/* lt_last_lost is prior_rcv_nxt */
+		bbr3_reset_lt_bw_sampling(sk);
+	bbr3_reset_lower_bounds(sk);
+	return max(tcp_sk(sk)->snd_cwnd, bbr->prior_cwnd);
+}
+
+/* tcp_sndbuf_expand() sizes sk_sndbuf to hold this many cwnds. The default of
+ * 2 is enough once cwnd spans what the model will send. Ask for 3 while it
+ * does not: in STARTUP, where cwnd doubles each round, and while 2 cwnds fall
+ * short of a bw probe's inflight plus a round of data at the probe rate, e.g.
+ * after a recovery or PROBE_RTT cut, or with cwnd bounded by inflight_hi.
+ */
+static u32 bbr3_sndbuf_expand(struct sock *sk)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 need;
+
+	if (bbr->mode == BBR_STARTUP)
+		return 3;
+
+	need = bbr3_bdp(sk, bbr3_max_bw(sk), bbr_bw_probe_cwnd_gain +
+			bbr_pacing_gain[BBR_BW_PROBE_UP]);
+	return need > 2 * tcp_sk(sk)->snd_cwnd ? 3 : 2;
+}
+
+/* Echo ECE on the ACKs to come iff they cover data of this CE state */
+static void bbr3_ece_ack_cwr(struct sock *sk, u32 ce_state)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+
+	if (ce_state)
+		tp->ecn_flags |= TCP_ECN_DEMAND_CWR;
+	else
+		tp->ecn_flags &= ~TCP_ECN_DEMAND_CWR;
+}
+
+/* The receiver side of bbr3_ecn, whose TCP_CONG_NEEDS_ECN has the stack
+ * hand us the CE codepoint of each data packet: echo it in ECE on exactly
+ * the ACKs that cover CE-marked data, as DCTCP receivers do, rather than
+ * latching ECE until CWR as RFC 3168 has it. This is what makes the peer's
+ * delivered_ce, and so its ecn_alpha, the fraction of CE-marked packets. A
+ * delayed ACK pending for data of the other CE state goes out first, with
+ * the state it covers. As dctcp_ece_ack_update() in net/ipv4/tcp_dctcp.h,
+ * which out-of-tree modules cannot include.
+ */
+static void bbr3_ece_ack_update(struct sock *sk, enum tcp_ca_event event)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	u32 ce_state = event == CA_EVENT_ECN_IS_CE;
+
+	if (bbr->ce_state != ce_state) {
+		if (inet_csk(sk)->icsk_ack.pending & ICSK_ACK_TIMER) {
+			bbr3_ece_ack_cwr(sk, bbr->ce_state);
+			__tcp_send_ack(sk, bbr->prior_rcv_nxt);
+		}
+		inet_csk(sk)->icsk_ack.pending |= ICSK_ACK_NOW;
+	}
+	bbr->prior_rcv_nxt = tcp_sk(sk)->rcv_nxt;
+	bbr->ce_state = ce_state;
+	bbr3_ece_ack_cwr(sk, ce_state);
+}
+
+/* Restart from idle. The model from before the idle period still holds, so
+ * resume at 1.0x the estimated bw rather than bursting a full cwnd or
+ * probing, and let the ACK epoch start over. Our queue drained while we were
+ * idle. If the idle lasted at least a PROBE_RTT hold (bbr_idle_drain_ms when
+ * PROBE_RTT is off), PROBE_RTT has done its job: leave it, and let the first
+ * RTT sample after the restart refresh min_rtt.
+ *
+ * The CE events only come to bbr3_ecn sockets, as receivers.
+ */
+static void bbr3_cwnd_event(struct sock *sk, enum tcp_ca_event event)
+{
+	struct bbr3 *bbr = inet_csk_ca(sk);
+	struct tcp_sock *tp = tcp_sk(sk);
+	u32 idle;
+
+	if (event == CA_EVENT_ECN_IS_CE || event == CA_EVENT_ECN_NO_CE) {
+		bbr3_ece_ack_update(sk, event);
+		return;
+	}
+	if (event != CA_EVENT_TX_START || !tp->app_limited)
+		return;
+
+	idle = tcp_jiffies32 - tp->lsndtime;
+	bbr->idle_restart = 1;
+	bbr->idle_drained = idle >= msecs_to_jiffies(bbr->probe_rtt_mode_ms ?:
+						     bbr_idle_drain_ms);
+	bbr->ack_epoch_mstamp = (u32)tp->tcp_mstamp;
+	bbr->ack_epoch_acked = 0;
+	if (bbr->mode == BBR_PROBE_BW) {
+		bbr3_set_pacing_rate(sk, bbr3_bw(sk), BBR_UNIT);
+	} else if (bbr->mode == BBR_PROBE_RTT) {
+		if (bbr->idle_drained ||
+		    (bbr->probe_rtt_done_stamp &&
+		     after(tcp_jiffies32, bbr->probe_rtt_done_stamp)))
+			bbr3_exit_probe_rtt(sk, bbr3_sk_version(sk));
+	}
+}
+
+#endif /* _TCP_BBR3_H */
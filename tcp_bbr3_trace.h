@@ -0,0 +1,272 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/* Tracepoints for BBRv3 congestion control
+ *
+ * Each event carries the socket cookie (as reported by sock_diag and
+ * bpf_get_socket_cookie()) so events can be joined per flow, with e.g.:
+ *
+ *   bpftrace -e 'tracepoint:tcp_bbr3:bbr3_cwnd_set { @[args->cookie] =
+ *                hist(args->cwnd); }'
+ *
+ * Disabled tracepoints cost a patched-out branch on the ACK path.
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM tcp_bbr3
+
+#if !defined(_TCP_BBR3_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TCP_BBR3_TRACE_H
+
+#include <linux/tracepoint.h>
+#include <linux/sock_diag.h>
+#include <net/tcp.h>
+
+/* bbr3_probe_rtt events */
+#define BBR3_PROBE_RTT_ENTER	0	/* min_rtt expired, cwnd cut */
+#define BBR3_PROBE_RTT_HOLD	1	/* inflight is down, hold starts */
+#define BBR3_PROBE_RTT_EXIT	2	/* hold done, cwnd restored */
+
+#define bbr3_trace_mode(mode)					\
+	__print_symbolic(mode,					\
+			 { 0, "STARTUP" }, { 1, "DRAIN" },	\
+			 { 2, "PROBE_BW" }, { 3, "PROBE_RTT" })
+
+/* sock_diag_save_cookie() generates the cookie on first use */
+#define bbr3_trace_cookie(sk) ({				\
+	__u32 __c[2];						\
+								\
+	sock_diag_save_cookie(sk, __c);				\
+	((u64)__c[1] << 32) | __c[0];				\
+})
+
+TRACE_EVENT(bbr3_state_change,
+
+	TP_PROTO(struct sock *sk, u8 old_mode, u8 old_cycle_idx, u8 mode,
+		 u8 cycle_idx, u32 bw, u32 min_rtt_us),
+
+	TP_ARGS(sk, old_mode, old_cycle_idx, mode, cycle_idx, bw, min_rtt_us),
+
+	TP_STRUCT__entry(
+		__field(u64, cookie)
+		__field(u8, old_mode)
+		__field(u8, old_cycle_idx)
+		__field(u8, mode)
+		__field(u8, cycle_idx)
+		__field(u32, bw)
+		__field(u32, min_rtt_us)
+		__field(u32, cwnd)
+		__field(u32, inflight)
+	),
+
+	TP_fast_assign(
+		__entry->cookie = bbr3_trace_cookie(sk);
+		__entry->old_mode = old_mode;
+		__entry->old_cycle_idx = old_cycle_idx;
+		__entry->mode = mode;
+		__entry->cycle_idx = cycle_idx;
+		__entry->bw = bw;
+		__entry->min_rtt_us = min_rtt_us;
+		__entry->cwnd = tcp_sk(sk)->snd_cwnd;
+		__entry->inflight = tcp_packets_in_flight(tcp_sk(sk));
+	),
+
+	TP_printk("cookie=%llu %s/%u -> %s/%u bw=%u min_rtt_us=%u cwnd=%u inflight=%u",
+		  __entry->cookie,
+		  bbr3_trace_mode(__entry->old_mode), __entry->old_cycle_idx,
+		  bbr3_trace_mode(__entry->mode), __entry->cycle_idx,
+		  __entry->bw, __entry->min_rtt_us, __entry->cwnd,
+		  __entry->inflight)
+);
+
+TRACE_EVENT(bbr3_bw_sample,
+
+	TP_PROTO(struct sock *sk, const struct rate_sample *rs, u32 sample_bw,
+		 u32 max_bw, u32 bw_lo, u32 rtt_cnt),
+
+	TP_ARGS(sk, rs, sample_bw, max_bw, bw_lo, rtt_cnt),
+
+	TP_STRUCT__entry(
+		__field(u64, cookie)
+		__field(u32, sample_bw)
+		__field(u32, max_bw)
+		__field(u32, bw_lo)
+		__field(u32, rtt_cnt)
+		__field(s32, delivered)
+		__field(long, interval_us)
+		__field(long, rtt_us)
+		__field(s32, losses)
+		__field(bool, is_app_limited)
+	),
+
+	TP_fast_assign(
+		__entry->cookie = bbr3_trace_cookie(sk);
+		__entry->sample_bw = sample_bw;
+		__entry->max_bw = max_bw;
+		__entry->bw_lo = bw_lo;
+		__entry->rtt_cnt = rtt_cnt;
+		__entry->delivered = rs->delivered;
+		__entry->interval_us = rs->interval_us;
+		__entry->rtt_us = rs->rtt_us;
+		__entry->losses = rs->losses;
+		__entry->is_app_limited = rs->is_app_limited;
+	),
+
+	TP_printk("cookie=%llu bw=%u max_bw=%u bw_lo=%u round=%u delivered=%d interval_us=%ld rtt_us=%ld losses=%d app_limited=%d",
+		  __entry->cookie, __entry->sample_bw, __entry->max_bw,
+		  __entry->bw_lo, __entry->rtt_cnt, __entry->delivered,
+		  __entry->interval_us, __entry->rtt_us, __entry->losses,
+		  __entry->is_app_limited)
+);
+
+TRACE_EVENT(bbr3_cwnd_set,
+
+	TP_PROTO(struct sock *sk, u8 mode, u32 bw, int gain, u32 target_cwnd,
+		 u32 prior_cwnd),
+
+	TP_ARGS(sk, mode, bw, gain, target_cwnd, prior_cwnd),
+
+	TP_STRUCT__entry(
+		__field(u64, cookie)
+		__field(u8, mode)
+		__field(u32, bw)
+		__field(int, gain)
+		__field(u32, target_cwnd)
+		__field(u32, prior_cwnd)
+		__field(u32, cwnd)
+		__field(u32, inflight)
+	),
+
+	TP_fast_assign(
+		__entry->cookie = bbr3_trace_cookie(sk);
+		__entry->mode = mode;
+		__entry->bw = bw;
+		__entry->gain = gain;
+		__entry->target_cwnd = target_cwnd;
+		__entry->prior_cwnd = prior_cwnd;
+		__entry->cwnd = tcp_sk(sk)->snd_cwnd;
+		__entry->inflight = tcp_packets_in_flight(tcp_sk(sk));
+	),
+
+	TP_printk("cookie=%llu mode=%s bw=%u cwnd_gain=%d target=%u cwnd=%u -> %u inflight=%u",
+		  __entry->cookie, bbr3_trace_mode(__entry->mode),
+		  __entry->bw, __entry->gain, __entry->target_cwnd,
+		  __entry->prior_cwnd, __entry->cwnd, __entry->inflight)
+);
+
+TRACE_EVENT(bbr3_probe_rtt,
+
+	TP_PROTO(struct sock *sk, u8 event, u32 min_rtt_us, u32 prior_cwnd),
+
+	TP_ARGS(sk, event, min_rtt_us, prior_cwnd),
+
+	TP_STRUCT__entry(
+		__field(u64, cookie)
+		__field(u8, event)
+		__field(u32, min_rtt_us)
+		__field(u32, prior_cwnd)
+		__field(u32, cwnd)
+		__field(u32, inflight)
+	),
+
+	TP_fast_assign(
+		__entry->cookie = bbr3_trace_cookie(sk);
+		__entry->event = event;
+		__entry->min_rtt_us = min_rtt_us;
+		__entry->prior_cwnd = prior_cwnd;
+		__entry->cwnd = tcp_sk(sk)->snd_cwnd;
+		__entry->inflight = tcp_packets_in_flight(tcp_sk(sk));
+	),
+
+	TP_printk("cookie=%llu %s min_rtt_us=%u prior_cwnd=%u cwnd=%u inflight=%u",
+		  __entry->cookie,
+		  __print_symbolic(__entry->event,
+				   { BBR3_PROBE_RTT_ENTER, "enter" },
+				   { BBR3_PROBE_RTT_HOLD, "hold" },
+				   { BBR3_PROBE_RTT_EXIT, "exit" }),
+		  __entry->min_rtt_us, __entry->prior_cwnd, __entry->cwnd,
+		  __entry->inflight)
+);
+
+/* Everything cong_control reads from the socket and the rate sample, on
+ * entry, so that flows can be captured and replayed through the model
+ * offline with sim/bbr3_replay. The key=value layout is what it parses.
+ */
+TRACE_EVENT(bbr3_ack,
+
+	TP_PROTO(struct sock *sk, const struct rate_sample *rs),
+
+	TP_ARGS(sk, rs),
+
+	TP_STRUCT__entry(
+		__field(u64, cookie)
+		__field(u64, mstamp)
+		__field(u64, delivered_mstamp)
+		__field(u32, delivered)
+		__field(u32, delivered_ce)
+		__field(u32, lost)
+		__field(u32, app_limited)
+		__field(u32, inflight)
+		__field(u32, srtt_us)
+		__field(u32, mss)
+		__field(u32, cwnd)
+		__field(u8, ca_state)
+		__field(u8, cwnd_limited)
+		__field(u8, rwnd_limited)
+		__field(u32, acked_sacked)
+		__field(s32, rs_delivered)
+		__field(u32, prior_delivered)
+		__field(long, interval_us)
+		__field(long, rtt_us)
+		__field(s32, losses)
+		__field(u32, prior_in_flight)
+		__field(bool, is_app_limited)
+		__field(bool, is_ack_delayed)
+	),
+
+	TP_fast_assign(
+		const struct tcp_sock *tp = tcp_sk(sk);
+
+		__entry->cookie = bbr3_trace_cookie(sk);
+		__entry->mstamp = tp->tcp_mstamp;
+		__entry->delivered_mstamp = tp->delivered_mstamp;
+		__entry->delivered = tp->delivered;
+		__entry->delivered_ce = tp->delivered_ce;
+		__entry->lost = tp->lost;
+		__entry->app_limited = tp->app_limited;
+		__entry->inflight = tcp_packets_in_flight(tp);
+		__entry->srtt_us = tp->srtt_us;
+		__entry->mss = tp->mss_cache;
+		__entry->cwnd = tp->snd_cwnd;
+		__entry->ca_state = inet_csk(sk)->icsk_ca_state;
+		__entry->cwnd_limited = tp->is_cwnd_limited;
+		__entry->rwnd_limited = tp->chrono_type == TCP_CHRONO_RWND_LIMITED;
+		__entry->acked_sacked = rs->acked_sacked;
+		__entry->rs_delivered = rs->delivered;
+		__entry->prior_delivered = rs->prior_delivered;
+		__entry->interval_us = rs->interval_us;
+		__entry->rtt_us = rs->rtt_us;
+		__entry->losses = rs->losses;
+		__entry->prior_in_flight = rs->prior_in_flight;
+		__entry->is_app_limited = rs->is_app_limited;
+		__entry->is_ack_delayed = rs->is_ack_delayed;
+	),
+
+	TP_printk("cookie=%llu mstamp=%llu delivered_mstamp=%llu delivered=%u delivered_ce=%u lost=%u app_limited=%u inflight=%u srtt_us=%u mss=%u cwnd=%u ca_state=%u cwnd_limited=%u rwnd_limited=%u rs_acked_sacked=%u rs_delivered=%d rs_prior_delivered=%u rs_interval_us=%ld rs_rtt_us=%ld rs_losses=%d rs_prior_in_flight=%u rs_app_limited=%d rs_ack_delayed=%d",
+		  __entry->cookie, __entry->mstamp, __entry->delivered_mstamp,
+		  __entry->delivered, __entry->delivered_ce, __entry->lost,
+		  __entry->app_limited, __entry->inflight, __entry->srtt_us,
+		  __entry->mss, __entry->cwnd, __entry->ca_state,
+		  __entry->cwnd_limited, __entry->rwnd_limited,
+		  __entry->acked_sacked,
+		  __entry->rs_delivered, __entry->prior_delivered,
+		  __entry->interval_us, __entry->rtt_us, __entry->losses,
+		  __entry->prior_in_flight, __entry->is_app_limited,
+		  __entry->is_ack_delayed)
+);
+
+#endif /* _TCP_BBR3_TRACE_H */
+
+/* This part must be outside protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE tcp_bbr3_trace
+#include <trace/define_trace.h>